@@ -0,0 +1,211 @@
+#include <string.h>
+#include <SDL2/SDL.h>
+
+#include "batch.h"
+#include "../utils.h"
+#include "../emulator/emulator.h"
+#include "../emulator/cartridge/cartridge.h"
+#include "../emulator/movie/movie.h"
+
+#define BATCH_LINE_MAX 1024
+
+typedef struct {
+    char *rom_path;
+    char *output_path;                  // Last frame as a binary PPM, NULL for none
+    char *movie_path;                   // Input played back on the job's instance, NULL for none
+    uint32_t frames;
+    bool failed;                        // Only written by the worker that ran the job
+} Batch_job;
+
+typedef struct {
+    Batch_job *jobs;
+    int job_count;
+    SDL_atomic_t next_job;              // First job no worker has taken yet
+    bool use_jit;
+} Batch;
+
+static int load_jobs(Batch *batch, const char *job_path);
+static void free_jobs(Batch *batch);
+static int worker(void *data);
+static int run_job(Batch *batch, int index);
+static int write_ppm(const char *path, const uint32_t *screen_buffer);
+
+int run_batch(const char *job_path, int threads, bool use_jit) {
+    Batch batch = {.jobs = NULL, .job_count = 0, .use_jit = use_jit};
+    SDL_AtomicSet(&batch.next_job, 0);
+    if (load_jobs(&batch, job_path) < 0) {
+        free_jobs(&batch);
+        return -1;
+    }
+
+    if (threads <= 0) threads = SDL_GetCPUCount();
+    if (threads > batch.job_count) threads = batch.job_count;
+    if (threads < 1) threads = 1;
+
+    /* Jobs are whole emulator runs, coarse enough that one shared cursor balances the pool as well as
+       per-worker queues would. Whoever finishes first takes the next job, the calling thread included */
+    SDL_Thread **pool = calloc(threads, sizeof(SDL_Thread *));
+    if (pool == NULL) {
+        free_jobs(&batch);
+        ERROR_RETURN("Unable to allocate a pool of %d workers", threads);
+    }
+    uint64_t start = SDL_GetPerformanceCounter();
+    for (int i = 1; i < threads; i++) {
+        pool[i] = SDL_CreateThread(worker, "batch worker", &batch);
+        if (pool[i] == NULL)
+            ERROR("Unable to start a batch worker, continuing with fewer\n    SDL error: %s", SDL_GetError());
+    }
+    worker(&batch);
+    for (int i = 1; i < threads; i++) {
+        if (pool[i]) SDL_WaitThread(pool[i], NULL);
+    }
+    double seconds = (double) (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+
+    uint64_t frames = 0;
+    int failures = 0;
+    for (int i = 0; i < batch.job_count; i++) {
+        if (batch.jobs[i].failed) failures++;
+        else frames += batch.jobs[i].frames;
+    }
+    printf("Batch: %d jobs (%d failed) on %d threads in %.3f s, %.1f frames per second\n",
+           batch.job_count, failures, threads, seconds, (seconds > 0) ? frames / seconds : 0.0);
+
+    free(pool);
+    free_jobs(&batch);
+    return failures;
+}
+
+static int load_jobs(Batch *batch, const char *job_path) {
+    FILE *job_file = fopen(job_path, "r");
+    if (job_file == NULL)
+        ERROR_RETURN("Unable to open job file: \"%s\"", job_path);
+
+    char line[BATCH_LINE_MAX], rom_path[BATCH_LINE_MAX], output_path[BATCH_LINE_MAX], movie_path[BATCH_LINE_MAX];
+    int capacity = 0, line_num = 0;
+    while (fgets(line, sizeof(line), job_file)) {
+        line_num++;
+        unsigned int frames;
+        int fields = sscanf(line, "%1023s %u %1023s %1023s", rom_path, &frames, output_path, movie_path);
+        if (fields < 1 || rom_path[0] == '#')
+            continue;
+        if (fields < 2) {
+            fclose(job_file);
+            ERROR_RETURN("Job file line %d: expected \"rom.nes frames [output.ppm|-] [movie.nesm|movie.fm2]\"",
+                         line_num);
+        }
+
+        if (batch->job_count == capacity) {
+            capacity = (capacity) ? capacity * 2 : 16;
+            Batch_job *jobs = realloc(batch->jobs, capacity * sizeof(Batch_job));
+            if (jobs == NULL) {
+                fclose(job_file);
+                ERROR_RETURN("Unable to allocate %d batch jobs", capacity);
+            }
+            batch->jobs = jobs;
+        }
+        batch->jobs[batch->job_count++] = (Batch_job) {
+            .rom_path = strdup(rom_path),
+            .output_path = (fields > 2 && strcmp(output_path, "-") != 0) ? strdup(output_path) : NULL,
+            .movie_path = (fields > 3) ? strdup(movie_path) : NULL,
+            .frames = frames,
+            .failed = false
+        };
+    }
+    fclose(job_file);
+
+    if (batch->job_count == 0)
+        ERROR_RETURN("No jobs in job file: \"%s\"", job_path);
+    return 0;
+}
+
+static void free_jobs(Batch *batch) {
+    for (int i = 0; i < batch->job_count; i++) {
+        free(batch->jobs[i].rom_path);
+        free(batch->jobs[i].output_path);
+        free(batch->jobs[i].movie_path);
+    }
+    free(batch->jobs);
+    batch->jobs = NULL;
+    batch->job_count = 0;
+}
+
+static int worker(void *data) {
+    Batch *batch = data;
+    int index;
+    while ((index = SDL_AtomicAdd(&batch->next_job, 1)) < batch->job_count)
+        batch->jobs[index].failed = (run_job(batch, index) < 0);
+    return 0;
+}
+
+static int run_job(Batch *batch, int index) {
+    // Every job owns its instance, nothing is shared between workers but the job list
+    Batch_job *job = &batch->jobs[index];
+    Emulator *emu = create_emulator();
+    if (emu == NULL)
+        ERROR_RETURN("Job %d: unable to allocate the emulator", index);
+    reset_cpu(emu);
+    reset_ppu(emu);
+    if (load_cartridge(&emu->mapper, job->rom_path) < 0) {
+        destroy_emulator(emu);
+        ERROR_RETURN("Job %d: unable to load NES cartridge %s", index, job->rom_path);
+    }
+    init_cpu(emu);
+    if (batch->use_jit) set_cpu_backend(emu, CPU_JIT);    // Stays on the interpreter when the host can't
+    Movie *movie = NULL;
+    if (job->movie_path && (movie = load_movie(job->movie_path)) == NULL) {
+        destroy_emulator(emu);
+        ERROR_RETURN("Job %d: unable to load movie %s", index, job->movie_path);
+    }
+
+    int status = 0;
+    uint64_t start = SDL_GetPerformanceCounter();
+    for (uint32_t frame = 0; frame < job->frames && status >= 0; frame++) {
+        // The controllers are released once the movie runs out
+        if (movie && status == 0 && (status = movie_next_frame(movie, emu, 0)) > 0)
+            memset(emu->controllers.buttons, 0, sizeof(emu->controllers.buttons));
+        if (status >= 0) run_frame(emu);
+    }
+    if (movie && status >= 0 && movie_finish(movie, emu) < 0)
+        status = -1;
+    double seconds = (double) (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+    char movie_summary[64] = "";
+    if (movie)
+        snprintf(movie_summary, sizeof(movie_summary), ", movie %u of %u frames%s", movie_position(movie),
+                 movie_length(movie), (status < 0) ? " desynced" : "");
+    destroy_movie(movie);
+    status = (status < 0) ? -1 : 0;
+
+    if (job->output_path && write_ppm(job->output_path, emu->ppu.screen_buffer) < 0)
+        status = -1;
+
+    uint64_t ram_hash = fnv_hash(emu->cpu.Bus.RAM, sizeof(emu->cpu.Bus.RAM), FNV_OFFSET_BASIS);
+    uint64_t frame_hash = fnv_hash(emu->ppu.screen_buffer, sizeof(emu->ppu.screen_buffer), FNV_OFFSET_BASIS);
+    // One printf per job so lines of concurrent workers don't interleave
+    printf("Job %d %s: %u frames, %lld cycles, RAM hash %016llx, frame hash %016llx, %.3f s%s\n",
+           index, job->rom_path, job->frames, (long long) emu->cycles,
+           (unsigned long long) ram_hash, (unsigned long long) frame_hash, seconds, movie_summary);
+
+    destroy_emulator(emu);
+    return status;
+}
+
+static int write_ppm(const char *path, const uint32_t *screen_buffer) {
+    FILE *ppm_file = fopen(path, "wb");
+    if (ppm_file == NULL)
+        ERROR_RETURN("Unable to open output file: \"%s\"", path);
+
+    // Screen buffer pixels are 0x00RRGGBB
+    Byte row[NES_WIDTH * 3];
+    fprintf(ppm_file, "P6\n%d %d\n255\n", NES_WIDTH, NES_HEIGHT);
+    for (int y = 0; y < NES_HEIGHT; y++) {
+        for (int x = 0; x < NES_WIDTH; x++) {
+            uint32_t pixel = screen_buffer[y * NES_WIDTH + x];
+            row[x * 3] = (Byte) (pixel >> 16);
+            row[x * 3 + 1] = (Byte) (pixel >> 8);
+            row[x * 3 + 2] = (Byte) pixel;
+        }
+        fwrite(row, 1, sizeof(row), ppm_file);
+    }
+    fclose(ppm_file);
+    return 0;
+}
@@ -0,0 +1,14 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+
+/* Batch mode, runs every job of a job file on its own emulator instance across a pool of worker threads.
+   One job per line, "rom.nes frames [output.ppm|-] [movie.nesm|movie.fm2]", blank lines and lines starting
+   with '#' are skipped. A movie plays its input back on the job's instance, '-' skips the output */
+
+// Streams one result line per finished job, threads <= 0 uses one worker per host core.
+// Returns the number of failed jobs, -1 when the job file can't be used
+int run_batch(const char *job_path, int threads, bool use_jit);
+
+#endif // !BATCH_H
@@ -0,0 +1,318 @@
+#include <stdbool.h>
+#include <string.h>
+
+#define SDL_MAIN_HANDLED
+#include <SDL2/SDL.h>
+
+#include "../utils.h"
+#include "../emulator/emulator.h"
+#include "../emulator/cartridge/cartridge.h"
+#include "../emulator/movie/movie.h"
+#include "../emulator/ppu/pixels.h"
+
+#define BENCH_LINE_MAX 1024
+#define BENCH_DEFAULT_SUITE "bench/suite.txt"
+#define BENCH_DEFAULT_REPEAT 3
+#define BENCH_DEFAULT_THRESHOLD 5.0     // Percent of frames per second a ROM can lose before it counts as a regression
+#define CSV_HEADER "rom,frames,seconds,fps,cycles_per_second,instructions_per_second,cpu_ms,ppu_ms,mapper_ms"
+
+typedef struct {
+    char *name;                         // ROM path as written in the suite, the key baselines are matched on
+    char *rom_path;
+    char *movie_path;                   // Scripted input, NULL for none
+    uint32_t frames;
+} Bench_entry;
+
+typedef struct {
+    bool failed;
+    double seconds;
+    double fps;
+    double cycles_per_second;
+    double instructions_per_second;
+    double cpu_ms;
+    double ppu_ms;
+    double mapper_ms;
+} Bench_result;
+
+typedef struct {
+    char *suite_path;
+    char *output_path;
+    char *baseline_path;
+    bool json;
+    bool use_jit;
+    int repeat;
+    double threshold;
+    Bench_entry *entries;
+    int entry_count;
+} Bench;
+
+static int parse_args(Bench *bench, int argc, char *argv[]);
+static int load_suite(Bench *bench);
+static void free_suite(Bench *bench);
+static char *suite_relative(const char *suite_path, const char *path);
+static Bench_result run_entry(const Bench *bench, const Bench_entry *entry);
+static int run_once(const Bench *bench, const Bench_entry *entry, Bench_result *result);
+static int write_report(const Bench *bench, const Bench_result *results);
+static void write_json_string(FILE *file, const char *string);
+static int compare_baseline(const Bench *bench, const Bench_result *results);
+
+int main(int argc, char *argv[]) {
+    Bench bench = {
+        .suite_path = BENCH_DEFAULT_SUITE, .repeat = BENCH_DEFAULT_REPEAT, .threshold = BENCH_DEFAULT_THRESHOLD
+    };
+    if (parse_args(&bench, argc, argv) < 0 || load_suite(&bench) < 0) {
+        free_suite(&bench);
+        printf("Usage: %s [--suite suite.txt] [--repeat N] [--jit] [--json] [--output report]\n", argv[0]);
+        printf("       %*s [--baseline report.csv [--threshold PERCENT]]\n", (int) strlen(argv[0]), "");
+        return EXIT_FAILURE;
+    }
+
+    set_pixel_pipeline(PIXELS_AUTO);
+    Bench_result *results = calloc(bench.entry_count, sizeof(Bench_result));
+    if (results == NULL) {
+        free_suite(&bench);
+        ERROR_EXIT("Unable to allocate %d benchmark results", bench.entry_count);
+    }
+    int failures = 0;
+    for (int i = 0; i < bench.entry_count; i++) {
+        results[i] = run_entry(&bench, &bench.entries[i]);
+        if (results[i].failed) failures++;
+    }
+
+    int status = write_report(&bench, results);
+    if (status == 0 && bench.baseline_path)
+        status = compare_baseline(&bench, results);
+
+    free(results);
+    free_suite(&bench);
+    return (status || failures) ? EXIT_FAILURE : 0;
+}
+
+static int parse_args(Bench *bench, int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0)
+            bench->json = true;
+        else if (strcmp(argv[i], "--jit") == 0)
+            bench->use_jit = true;
+        else if (i + 1 >= argc) {
+            ERROR_RETURN("Unknown option or missing value: %s", argv[i]);
+        }
+        else if (strcmp(argv[i], "--suite") == 0)
+            bench->suite_path = argv[++i];
+        else if (strcmp(argv[i], "--output") == 0)
+            bench->output_path = argv[++i];
+        else if (strcmp(argv[i], "--baseline") == 0)
+            bench->baseline_path = argv[++i];
+        else if (strcmp(argv[i], "--repeat") == 0)
+            bench->repeat = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threshold") == 0)
+            bench->threshold = atof(argv[++i]);
+        else
+            ERROR_RETURN("Unknown option: %s", argv[i]);
+    }
+    if (bench->repeat < 1) bench->repeat = 1;
+    return 0;
+}
+
+static int load_suite(Bench *bench) {
+    FILE *suite_file = fopen(bench->suite_path, "r");
+    if (suite_file == NULL)
+        ERROR_RETURN("Unable to open benchmark suite: \"%s\"", bench->suite_path);
+
+    char line[BENCH_LINE_MAX], rom_path[BENCH_LINE_MAX], movie_path[BENCH_LINE_MAX];
+    int capacity = 0, line_num = 0;
+    while (fgets(line, sizeof(line), suite_file)) {
+        line_num++;
+        unsigned int frames;
+        int fields = sscanf(line, "%1023s %u %1023s", rom_path, &frames, movie_path);
+        if (fields < 1 || rom_path[0] == '#')
+            continue;
+        if (fields < 2) {
+            fclose(suite_file);
+            ERROR_RETURN("Suite line %d: expected \"rom.nes frames [movie.nesm|movie.fm2]\"", line_num);
+        }
+
+        if (bench->entry_count == capacity) {
+            capacity = (capacity) ? capacity * 2 : 16;
+            Bench_entry *entries = realloc(bench->entries, capacity * sizeof(Bench_entry));
+            if (entries == NULL) {
+                fclose(suite_file);
+                ERROR_RETURN("Unable to allocate %d benchmark entries", capacity);
+            }
+            bench->entries = entries;
+        }
+        bench->entries[bench->entry_count++] = (Bench_entry) {
+            .name = strdup(rom_path),
+            .rom_path = suite_relative(bench->suite_path, rom_path),
+            .movie_path = (fields > 2) ? suite_relative(bench->suite_path, movie_path) : NULL,
+            .frames = frames
+        };
+    }
+    fclose(suite_file);
+
+    if (bench->entry_count == 0)
+        ERROR_RETURN("No ROMs in benchmark suite: \"%s\"", bench->suite_path);
+    return 0;
+}
+
+static void free_suite(Bench *bench) {
+    for (int i = 0; i < bench->entry_count; i++) {
+        free(bench->entries[i].name);
+        free(bench->entries[i].rom_path);
+        free(bench->entries[i].movie_path);
+    }
+    free(bench->entries);
+    bench->entries = NULL;
+    bench->entry_count = 0;
+}
+
+static char *suite_relative(const char *suite_path, const char *path) {
+    // Suite paths are relative to the suite file, so the suite runs from any working directory
+    const char *slash = strrchr(suite_path, '/'), *backslash = strrchr(suite_path, '\\');
+    if (backslash > slash) slash = backslash;
+    if (slash == NULL || path[0] == '/' || path[0] == '\\' || (path[0] && path[1] == ':'))
+        return strdup(path);
+    size_t dir_length = slash - suite_path + 1;
+    char *joined = malloc(dir_length + strlen(path) + 1);
+    if (joined == NULL)
+        return NULL;
+    memcpy(joined, suite_path, dir_length);
+    strcpy(joined + dir_length, path);
+    return joined;
+}
+
+static Bench_result run_entry(const Bench *bench, const Bench_entry *entry) {
+    // Best of the repeats, the one the fewest other processes got in the way of
+    Bench_result best = {.failed = true};
+    for (int i = 0; i < bench->repeat; i++) {
+        Bench_result result;
+        if (run_once(bench, entry, &result) < 0)
+            return (Bench_result) {.failed = true};
+        if (best.failed || result.seconds < best.seconds)
+            best = result;
+    }
+    return best;
+}
+
+static int run_once(const Bench *bench, const Bench_entry *entry, Bench_result *result) {
+    Emulator *emu = create_emulator();
+    if (emu == NULL)
+        ERROR_RETURN("%s: unable to allocate the emulator", entry->name);
+    reset_cpu(emu);
+    reset_ppu(emu);
+    if (load_cartridge(&emu->mapper, entry->rom_path) < 0) {
+        destroy_emulator(emu);
+        ERROR_RETURN("%s: unable to load NES cartridge %s", entry->name, entry->rom_path);
+    }
+    init_cpu(emu);
+    if (bench->use_jit) set_cpu_backend(emu, CPU_JIT);
+    Movie *movie = NULL;
+    if (entry->movie_path && (movie = load_movie(entry->movie_path)) == NULL) {
+        destroy_emulator(emu);
+        ERROR_RETURN("%s: unable to load movie %s", entry->name, entry->movie_path);
+    }
+    emu->profile = (Profile) {0};
+
+    int status = 0;
+    uint64_t start = SDL_GetPerformanceCounter();
+    for (uint32_t frame = 0; frame < entry->frames && status >= 0; frame++) {
+        // The controllers are released once the script runs out
+        if (movie && status == 0 && (status = movie_next_frame(movie, emu, 0)) > 0)
+            memset(emu->controllers.buttons, 0, sizeof(emu->controllers.buttons));
+        if (status >= 0) run_frame(emu);
+    }
+    uint64_t ticks = SDL_GetPerformanceCounter() - start;
+
+    double frequency = (double) SDL_GetPerformanceFrequency();
+    double seconds = (ticks) ? ticks / frequency : 1.0 / frequency;
+    uint64_t cpu_ticks = ticks - emu->profile.ppu_ticks - emu->profile.mapper_ticks;
+    *result = (Bench_result) {
+        .failed = (status < 0),
+        .seconds = seconds,
+        .fps = entry->frames / seconds,
+        .cycles_per_second = emu->cycles / seconds,
+        .instructions_per_second = emu->profile.instructions / seconds,
+        .cpu_ms = cpu_ticks * 1e3 / frequency,
+        .ppu_ms = emu->profile.ppu_ticks * 1e3 / frequency,
+        .mapper_ms = emu->profile.mapper_ticks * 1e3 / frequency
+    };
+    destroy_movie(movie);
+    destroy_emulator(emu);
+    if (status < 0)
+        ERROR_RETURN("%s: scripted input desynced", entry->name);
+    return 0;
+}
+
+static int write_report(const Bench *bench, const Bench_result *results) {
+    FILE *report = (bench->output_path) ? fopen(bench->output_path, "w") : stdout;
+    if (report == NULL)
+        ERROR_RETURN("Unable to open benchmark report: \"%s\"", bench->output_path);
+
+    if (bench->json)
+        fprintf(report, "{\n  \"backend\": \"%s\",\n  \"results\": [", (bench->use_jit) ? "jit" : "interpreter");
+    else
+        fprintf(report, "%s\n", CSV_HEADER);
+    for (int i = 0, written = 0; i < bench->entry_count; i++) {
+        const Bench_result *result = &results[i];
+        if (result->failed)
+            continue;                   // Failed ROMs were reported, they have nothing to compare against
+        if (bench->json) {
+            fprintf(report, "%s\n    {\"rom\": ", (written++) ? "," : "");
+            write_json_string(report, bench->entries[i].name);
+            fprintf(report, ", \"frames\": %u, \"seconds\": %.4f, \"fps\": %.2f, \"cycles_per_second\": %.0f, "
+                            "\"instructions_per_second\": %.0f, \"cpu_ms\": %.2f, \"ppu_ms\": %.2f, \"mapper_ms\": %.2f}",
+                    bench->entries[i].frames, result->seconds, result->fps, result->cycles_per_second,
+                    result->instructions_per_second, result->cpu_ms, result->ppu_ms, result->mapper_ms);
+        }
+        else
+            fprintf(report, "%s,%u,%.4f,%.2f,%.0f,%.0f,%.2f,%.2f,%.2f\n", bench->entries[i].name,
+                    bench->entries[i].frames, result->seconds, result->fps, result->cycles_per_second,
+                    result->instructions_per_second, result->cpu_ms, result->ppu_ms, result->mapper_ms);
+    }
+    if (bench->json)
+        fprintf(report, "\n  ]\n}\n");
+
+    if (report != stdout && fclose(report) != 0)
+        ERROR_RETURN("Unable to write benchmark report: \"%s\"", bench->output_path);
+    return 0;
+}
+
+static void write_json_string(FILE *file, const char *string) {
+    fputc('"', file);
+    for (; *string; string++) {
+        if (*string == '"' || *string == '\\') fputc('\\', file);
+        fputc(*string, file);
+    }
+    fputc('"', file);
+}
+
+static int compare_baseline(const Bench *bench, const Bench_result *results) {
+    // Baselines are earlier CSV reports, matched on the ROM path written in the suite
+    FILE *baseline = fopen(bench->baseline_path, "r");
+    if (baseline == NULL)
+        ERROR_RETURN("Unable to open baseline: \"%s\"", bench->baseline_path);
+
+    char line[BENCH_LINE_MAX], name[BENCH_LINE_MAX];
+    int regressions = 0, compared = 0;
+    while (fgets(line, sizeof(line), baseline)) {
+        unsigned int frames;
+        double seconds, fps;
+        if (sscanf(line, "%1023[^,],%u,%lf,%lf", name, &frames, &seconds, &fps) != 4 || fps <= 0)
+            continue;                   // Header and malformed lines
+        for (int i = 0; i < bench->entry_count; i++) {
+            if (strcmp(bench->entries[i].name, name) != 0 || results[i].failed)
+                continue;
+            double change = (results[i].fps - fps) * 100 / fps;
+            bool regressed = change < -bench->threshold;
+            fprintf(stderr, "%s: %.2f fps, baseline %.2f fps (%+.1f%%)%s\n", name, results[i].fps, fps, change,
+                    (regressed) ? "  REGRESSION" : "");
+            regressions += regressed;
+            compared++;
+        }
+    }
+    fclose(baseline);
+
+    fprintf(stderr, "Baseline: %d ROMs compared, %d regressed more than %.1f%%\n", compared, regressions,
+            bench->threshold);
+    return (regressions) ? 1 : 0;
+}
@@ -0,0 +1,377 @@
+#include <stdbool.h>
+#include <string.h>
+
+#define SDL_MAIN_HANDLED
+#include <SDL2/SDL.h>
+
+#include "../utils.h"
+#include "../emulator/emulator.h"
+#include "../emulator/6502/instructions.h"
+#include "../emulator/ppu/pixels.h"
+
+#define DISTRIBUTION_SIZE 4096          // Addresses per distribution, a power of two small enough to stay in L1
+#define DISTRIBUTION_MASK (DISTRIBUTION_SIZE - 1)
+#define MICROBENCH_DEFAULT_ITERATIONS (1 << 22)
+#define MICROBENCH_DEFAULT_REPEAT 5
+#define MICROBENCH_SEED 0x2C9277B5
+#define CSV_HEADER "function,distribution,ns_per_op"
+
+typedef struct {
+    Emulator *emu;
+    Word addresses[DISTRIBUTION_SIZE];
+    uint64_t iterations;
+} Micro_context;
+
+typedef struct {
+    const char *name;
+    const char *distribution;
+    enum Mirror_type mirroring;
+    Byte PRG_ROM_banks;
+    void (*generate)(Word *addresses, uint32_t *seed);
+    uint32_t (*run)(Micro_context *context);
+    enum Pixel_pipeline pixels;         // Left out for the best one the host supports
+} Micro_case;
+
+typedef struct {
+    const char *filter;
+    uint64_t iterations;
+    int repeat;
+} Microbench;
+
+static int parse_args(Microbench *bench, int argc, char *argv[]);
+static int run_case(const Microbench *bench, const Micro_case *micro_case, double *ns_per_op);
+static Emulator *create_synthetic_console(const Micro_case *micro_case, uint32_t *seed);
+static uint32_t next_random(uint32_t *seed);
+
+static void generate_cpu_reads(Word *addresses, uint32_t *seed);
+static void generate_cpu_writes(Word *addresses, uint32_t *seed);
+static void generate_branch_targets(Word *addresses, uint32_t *seed);
+static void generate_nametable_fetches(Word *addresses, uint32_t *seed);
+static void generate_pattern_fetches(Word *addresses, uint32_t *seed);
+static void generate_palette_reads(Word *addresses, uint32_t *seed);
+static void generate_tile_rows(Word *addresses, uint32_t *seed);
+static void generate_prg_reads(Word *addresses, uint32_t *seed);
+static void generate_chr_reads(Word *addresses, uint32_t *seed);
+
+static uint32_t run_cpu_read_byte(Micro_context *context);
+static uint32_t run_cpu_write_byte(Micro_context *context);
+static uint32_t run_fetch_byte(Micro_context *context);
+static uint32_t run_fetch_word(Micro_context *context);
+static uint32_t run_ppu_read_byte(Micro_context *context);
+static uint32_t run_get_tile_row(Micro_context *context);
+static uint32_t run_draw_pixel_row(Micro_context *context);
+static uint32_t run_mapper_cpu_read(Micro_context *context);
+static uint32_t run_mapper_ppu_read(Micro_context *context);
+
+static const Micro_case micro_cases[] = {
+    {"cpu_read_byte", "45% zero page, 10% stack, 25% RAM and mirrors, 20% PRG data", HORIZONTAL, 2,
+     generate_cpu_reads, run_cpu_read_byte},
+    {"cpu_write_byte", "50% zero page, 15% stack, 35% RAM", HORIZONTAL, 2, generate_cpu_writes, run_cpu_write_byte},
+    {"fetch_byte", "runs of 8 opcode bytes from random PRG targets", HORIZONTAL, 2,
+     generate_branch_targets, run_fetch_byte},
+    {"fetch_word", "runs of 4 operands from random PRG targets", HORIZONTAL, 2, generate_branch_targets, run_fetch_word},
+    {"ppu_read_byte", "nametable rows with attributes, horizontal mirroring", HORIZONTAL, 2,
+     generate_nametable_fetches, run_ppu_read_byte},
+    {"ppu_read_byte", "nametable rows with attributes, vertical mirroring", VERTICAL, 2,
+     generate_nametable_fetches, run_ppu_read_byte},
+    {"ppu_read_byte", "pattern planes of random tiles", HORIZONTAL, 2, generate_pattern_fetches, run_ppu_read_byte},
+    {"ppu_read_byte", "palette entries and their mirrors", HORIZONTAL, 2, generate_palette_reads, run_ppu_read_byte},
+    {"get_tile_row", "random tiles of both tables, fine y in order", HORIZONTAL, 2, generate_tile_rows, run_get_tile_row},
+    {"draw_pixel_row", "random tile rows and palettes, scanlines left to right, scalar", HORIZONTAL, 2,
+     generate_tile_rows, run_draw_pixel_row, PIXELS_SCALAR},
+    {"draw_pixel_row", "random tile rows and palettes, scanlines left to right, SSE2", HORIZONTAL, 2,
+     generate_tile_rows, run_draw_pixel_row, PIXELS_SSE2},
+    {"draw_pixel_row", "random tile rows and palettes, scanlines left to right, AVX2", HORIZONTAL, 2,
+     generate_tile_rows, run_draw_pixel_row, PIXELS_AVX2},
+    {"nrom_cpu_read", "random PRG bytes, 16KB mirrored", HORIZONTAL, 1, generate_prg_reads, run_mapper_cpu_read},
+    {"nrom_cpu_read", "random PRG bytes, 32KB", HORIZONTAL, 2, generate_prg_reads, run_mapper_cpu_read},
+    {"nrom_ppu_read", "random CHR bytes", HORIZONTAL, 2, generate_chr_reads, run_mapper_ppu_read},
+};
+
+#define MICRO_CASE_COUNT ((int) (sizeof(micro_cases) / sizeof(micro_cases[0])))
+
+// Keeps the results of the timed loops alive
+static volatile uint32_t sink;
+
+int main(int argc, char *argv[]) {
+    Microbench bench = {.iterations = MICROBENCH_DEFAULT_ITERATIONS, .repeat = MICROBENCH_DEFAULT_REPEAT};
+    if (parse_args(&bench, argc, argv) < 0) {
+        printf("Usage: %s [--filter FUNCTION] [--iterations N] [--repeat N]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int failures = 0, matched = 0;
+    printf("%s\n", CSV_HEADER);
+    for (int i = 0; i < MICRO_CASE_COUNT; i++) {
+        const Micro_case *micro_case = &micro_cases[i];
+        if (bench.filter && strstr(micro_case->name, bench.filter) == NULL)
+            continue;
+        matched++;
+        double ns_per_op;
+        int status = run_case(&bench, micro_case, &ns_per_op);
+        if (status < 0)
+            failures++;
+        if (status != 0)
+            continue;
+        printf("%s,\"%s\",%.3f\n", micro_case->name, micro_case->distribution, ns_per_op);
+        fflush(stdout);
+    }
+    if (matched == 0)
+        ERROR_EXIT("No microbenchmark matches \"%s\"", bench.filter);
+    return (failures) ? EXIT_FAILURE : 0;
+}
+
+static int parse_args(Microbench *bench, int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            ERROR_RETURN("Unknown option or missing value: %s", argv[i]);
+        }
+        else if (strcmp(argv[i], "--filter") == 0)
+            bench->filter = argv[++i];
+        else if (strcmp(argv[i], "--iterations") == 0)
+            bench->iterations = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--repeat") == 0)
+            bench->repeat = atoi(argv[++i]);
+        else
+            ERROR_RETURN("Unknown option: %s", argv[i]);
+    }
+    if (bench->iterations < 1) bench->iterations = 1;
+    if (bench->repeat < 1) bench->repeat = 1;
+    return 0;
+}
+
+static int run_case(const Microbench *bench, const Micro_case *micro_case, double *ns_per_op) {
+    if (!set_pixel_pipeline(micro_case->pixels)) {
+        fprintf(stderr, "%s: skipped, no %s on this host\n", micro_case->name, pixel_pipeline_name(micro_case->pixels));
+        return 1;
+    }
+    // Same seed for every case, so a distribution is identical from run to run and between builds
+    uint32_t seed = MICROBENCH_SEED;
+    Micro_context *context = calloc(1, sizeof(Micro_context));
+    if (context == NULL)
+        ERROR_RETURN("%s: unable to allocate the distribution", micro_case->name);
+    if ((context->emu = create_synthetic_console(micro_case, &seed)) == NULL) {
+        free(context);
+        ERROR_RETURN("%s: unable to create the console", micro_case->name);
+    }
+    micro_case->generate(context->addresses, &seed);
+    context->iterations = bench->iterations;
+
+    // Best of the repeats, after one untimed pass that warms the caches and the branch predictors
+    double frequency = (double) SDL_GetPerformanceFrequency();
+    double best = 0.0;
+    sink ^= micro_case->run(context);
+    for (int i = 0; i < bench->repeat; i++) {
+        uint64_t start = SDL_GetPerformanceCounter();
+        sink ^= micro_case->run(context);
+        double seconds = (SDL_GetPerformanceCounter() - start) / frequency;
+        if (i == 0 || seconds < best)
+            best = seconds;
+    }
+    *ns_per_op = best * 1e9 / bench->iterations;
+
+    destroy_emulator(context->emu);
+    free(context);
+    return 0;
+}
+
+static Emulator *create_synthetic_console(const Micro_case *micro_case, uint32_t *seed) {
+    // An NROM cartridge of random bytes, no ROM file needed and nothing the functions measured depend on
+    Emulator *emu = create_emulator();
+    if (emu == NULL)
+        return NULL;
+    reset_cpu(emu);
+    reset_ppu(emu);
+    Mapper *mapper = &emu->mapper;
+    mapper->PRG_ROM_banks = micro_case->PRG_ROM_banks;
+    mapper->PRG_ROM_p = malloc(mapper->PRG_ROM_banks * 0x4000);
+    mapper->CHR_ROM_banks = 1;
+    mapper->CHR_ROM_p = malloc(0x2000);
+    if (!mapper->PRG_ROM_p || !mapper->CHR_ROM_p || load_mapper_functions(mapper, NROM, micro_case->mirroring) < 0) {
+        destroy_emulator(emu);
+        return NULL;
+    }
+    for (int i = 0; i < mapper->PRG_ROM_banks * 0x4000; i++)
+        mapper->PRG_ROM_p[i] = (Byte) next_random(seed);
+    for (int i = 0; i < 0x2000; i++)
+        mapper->CHR_ROM_p[i] = (Byte) next_random(seed);
+    for (int i = 0; i < (int) sizeof(emu->ppu.Bus.Nametable); i++)
+        emu->ppu.Bus.Nametable[i / 1024][i % 1024] = (Byte) next_random(seed);
+    for (int i = 0; i < (int) sizeof(emu->ppu.Bus.Palettes); i++)
+        emu->ppu.Bus.Palettes[i] = (Byte) next_random(seed);
+    // Decoded as they are after the first frame
+    for (Word tile = 0; tile < TILE_COUNT; tile++)
+        get_tile_row(emu, tile, 0);
+
+    // init_cpu() without the reset vector, every case places PC itself
+    map_cpu_pages(emu);
+    map_nametables(emu);
+    emu->cpu.PC = 0x8000;
+    return emu;
+}
+
+static uint32_t next_random(uint32_t *seed) {
+    // xorshift32
+    uint32_t x = *seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *seed = x;
+}
+
+/* Distributions */
+
+static void generate_cpu_reads(Word *addresses, uint32_t *seed) {
+    for (int i = 0; i < DISTRIBUTION_SIZE; i++) {
+        uint32_t pick = next_random(seed) % 100, offset = next_random(seed);
+        if (pick < 45)
+            addresses[i] = offset & 0xFF;
+        else if (pick < 55)
+            addresses[i] = 0x0100 | (offset & 0xFF);
+        else if (pick < 75)
+            addresses[i] = 0x0200 + offset % 0x0600;
+        else if (pick < 80)
+            addresses[i] = 0x0800 + offset % 0x1800;
+        else
+            addresses[i] = 0x8000 | (offset & 0x7FFF);
+    }
+}
+
+static void generate_cpu_writes(Word *addresses, uint32_t *seed) {
+    for (int i = 0; i < DISTRIBUTION_SIZE; i++) {
+        uint32_t pick = next_random(seed) % 100, offset = next_random(seed);
+        if (pick < 50)
+            addresses[i] = offset & 0xFF;
+        else if (pick < 65)
+            addresses[i] = 0x0100 | (offset & 0xFF);
+        else
+            addresses[i] = 0x0200 + offset % 0x0600;
+    }
+}
+
+static void generate_branch_targets(Word *addresses, uint32_t *seed) {
+    // Far enough below $FFFF that no run wraps to $8000
+    for (int i = 0; i < DISTRIBUTION_SIZE; i++)
+        addresses[i] = 0x8000 + next_random(seed) % 0x7FF0;
+}
+
+static void generate_nametable_fetches(Word *addresses, uint32_t *seed) {
+    // What the background fetches of a scanline read, 32 tiles with the attribute byte of each
+    for (int i = 0; i < DISTRIBUTION_SIZE; i += 64) {
+        Word nametable = 0x2000 | ((next_random(seed) & 0x3) << 10);
+        Word row = next_random(seed) % 30;
+        for (int column = 0; column < 32; column++) {
+            addresses[i + column * 2] = nametable | (row << 5) | column;
+            addresses[i + column * 2 + 1] = nametable | 0x3C0 | ((row >> 2) << 3) | (column >> 2);
+        }
+    }
+}
+
+static void generate_pattern_fetches(Word *addresses, uint32_t *seed) {
+    for (int i = 0; i < DISTRIBUTION_SIZE; i += 16) {
+        Word tile = (next_random(seed) & 0x1FF) << 4;
+        for (int fine_y = 0; fine_y < 8; fine_y++) {
+            addresses[i + fine_y * 2] = tile | fine_y;
+            addresses[i + fine_y * 2 + 1] = tile | 0x8 | fine_y;
+        }
+    }
+}
+
+static void generate_palette_reads(Word *addresses, uint32_t *seed) {
+    for (int i = 0; i < DISTRIBUTION_SIZE; i++)
+        addresses[i] = 0x3F00 | (next_random(seed) & 0xFF);
+}
+
+static void generate_tile_rows(Word *addresses, uint32_t *seed) {
+    // Tile in bits 4 - 12, fine y in bits 0 - 2
+    for (int i = 0; i < DISTRIBUTION_SIZE; i += 8) {
+        Word tile = (next_random(seed) & 0x1FF) << 4;
+        for (int fine_y = 0; fine_y < 8; fine_y++)
+            addresses[i + fine_y] = tile | fine_y;
+    }
+}
+
+static void generate_prg_reads(Word *addresses, uint32_t *seed) {
+    for (int i = 0; i < DISTRIBUTION_SIZE; i++)
+        addresses[i] = 0x8000 | (next_random(seed) & 0x7FFF);
+}
+
+static void generate_chr_reads(Word *addresses, uint32_t *seed) {
+    for (int i = 0; i < DISTRIBUTION_SIZE; i++)
+        addresses[i] = next_random(seed) & 0x1FFF;
+}
+
+/* Timed loops, one call of the measured function per iteration */
+
+static uint32_t run_cpu_read_byte(Micro_context *context) {
+    uint32_t result = 0;
+    for (uint64_t i = 0; i < context->iterations; i++)
+        result += cpu_read_byte(context->emu, context->addresses[i & DISTRIBUTION_MASK]);
+    return result;
+}
+
+static uint32_t run_cpu_write_byte(Micro_context *context) {
+    for (uint64_t i = 0; i < context->iterations; i++)
+        cpu_write_byte(context->emu, context->addresses[i & DISTRIBUTION_MASK], (Byte) i);
+    return context->emu->cpu.Bus.RAM[0];
+}
+
+static uint32_t run_fetch_byte(Micro_context *context) {
+    uint32_t result = 0;
+    for (uint64_t i = 0; i < context->iterations; i++) {
+        if (!(i & 0x7)) context->emu->cpu.PC = context->addresses[(i >> 3) & DISTRIBUTION_MASK];
+        result += fetch_byte(context->emu);
+    }
+    return result;
+}
+
+static uint32_t run_fetch_word(Micro_context *context) {
+    uint32_t result = 0;
+    for (uint64_t i = 0; i < context->iterations; i++) {
+        if (!(i & 0x3)) context->emu->cpu.PC = context->addresses[(i >> 2) & DISTRIBUTION_MASK];
+        result += fetch_word(context->emu);
+    }
+    return result;
+}
+
+static uint32_t run_ppu_read_byte(Micro_context *context) {
+    uint32_t result = 0;
+    for (uint64_t i = 0; i < context->iterations; i++)
+        result += ppu_read_byte(context->emu, context->addresses[i & DISTRIBUTION_MASK]);
+    return result;
+}
+
+static uint32_t run_get_tile_row(Micro_context *context) {
+    uint32_t result = 0;
+    for (uint64_t i = 0; i < context->iterations; i++) {
+        Word tile_row = context->addresses[i & DISTRIBUTION_MASK];
+        result += get_tile_row(context->emu, tile_row >> 4, tile_row & 0x7)[0];
+    }
+    return result;
+}
+
+static uint32_t run_draw_pixel_row(Micro_context *context) {
+    PPU *ppu = &context->emu->ppu;
+    for (uint64_t i = 0; i < context->iterations; i++) {
+        Word tile_row = context->addresses[i & DISTRIBUTION_MASK];
+        draw_pixel_row(context->emu, ppu->tile_pixels[tile_row >> 4][tile_row & 0x7], ppu->screen_buffer,
+                       (Byte) (i >> 5) & 0x3, (int) (i & 0x1F) * 8, (int) ((i >> 5) % NES_HEIGHT));
+    }
+    return ppu->screen_buffer[0];
+}
+
+static uint32_t run_mapper_cpu_read(Micro_context *context) {
+    Mapper *mapper = &context->emu->mapper;
+    uint32_t result = 0;
+    for (uint64_t i = 0; i < context->iterations; i++)
+        result += mapper->cpu_read(mapper, context->addresses[i & DISTRIBUTION_MASK]);
+    return result;
+}
+
+static uint32_t run_mapper_ppu_read(Micro_context *context) {
+    Mapper *mapper = &context->emu->mapper;
+    uint32_t result = 0;
+    for (uint64_t i = 0; i < context->iterations; i++)
+        result += mapper->ppu_read(mapper, context->addresses[i & DISTRIBUTION_MASK]);
+    return result;
+}
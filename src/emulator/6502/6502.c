@@ -1,52 +1,151 @@
 #include <stdio.h>
+#include <string.h>
 
 #include "instructions.h"
+#include "jit.h"
 #include "../cartridge/cartridge.h"
-#include "../global.h"
+#include "../emulator.h"
 
-int64_t *p_total_cycles;
-
-int cpu_clock(void) {
-    *p_total_cycles += 1;
-    for (int i = 0; i < 3; i++) ppu_clock();
+int cpu_clock(Emulator *emu) {
+    // The PPU is not clocked here, it catches up in sync_ppu() when the CPU can observe it
+    emu->cycles += 1;
     return 0;
 }
 
-void reset_cpu(void) {
-    *p_cpu = (CPU) {
+void reset_cpu(Emulator *emu) {
+    CPU *cpu = &emu->cpu;
+    *cpu = (CPU) {
         .PC = 0xFFFC,                       // Initializing program counter at 0xFFFC
         .A = 0, .X = 0, .Y = 0,             // All registers to 0
-        .D = 0,                             // Setting Decimal flag to 0
-        .I = 0,                             // Interrupt Disable to 0
-        .C = 0, .V = 0, .N = 0,             // Carry, Overflow and Negative flags set to 0
-        .Z = 1,                             // Zero flag to 1 (since Accumulator is 0)
+        .P = 0,                             // Decimal, Interrupt Disable and Carry flags to 0
+        .n_result = 0, .v_result = 0,       // Negative and Overflow flags to 0
+        .z_result = 0,                      // Zero flag to 1 (since Accumulator is 0)
         .SP = 0x01FF,                       // Stack pointer to bottom of stack (0x01FF)
-        .temp_byte = 0, .temp_word = 0
     };
-    memset(p_cpu->Bus.RAM, 0, 2048);
-    memset(p_cpu->Bus.APU_registers, 0, 18);
+    memset(cpu->Bus.RAM, 0, 2048);
+    memset(cpu->Bus.APU_registers, 0, 18);
 }
 
-void init_cpu(int64_t *cycles) {
+void init_cpu(Emulator *emu) {
     printf("Initializing CPU...\n");
-    p_total_cycles = cycles;
-    p_cpu->PC = fetch_word();
-}
-
-void execute_cpu_ppu(void) {
-    Byte op_code = fetch_byte();
-    cpu_clock();
-    Ins ins_struct = ins_table[op_code];
-    ins_struct.address_mode();
-    ins_struct.operation();
-    if (p_ppu->create_nmi && p_ppu->PPUCTRL.Generate_NMI) {
-        p_ppu->create_nmi = false;
-        cpu_nmi();
+    reset_scheduler(emu);
+    schedule_ppu_events(emu);
+    map_cpu_pages(emu);
+    map_nametables(emu);
+    emu->cpu.PC = fetch_word(emu);
+}
+
+void map_cpu_pages(Emulator *emu) {
+    // Called again by mappers whenever they switch PRG banks
+    CPU *cpu = &emu->cpu;
+    Byte *mapped[256];
+    memcpy(mapped, cpu->read_pages, sizeof(mapped));
+    for (int page = 0; page < 256; page++) {
+        cpu->read_pages[page] = NULL;
+        cpu->write_pages[page] = NULL;
+    }
+    // 2KB of RAM mirrored across 8KB
+    for (int page = 0x00; page < 0x20; page++) {
+        cpu->read_pages[page] = &cpu->Bus.RAM[(page & 0x07) << 8];
+        cpu->write_pages[page] = &cpu->Bus.RAM[(page & 0x07) << 8];
+    }
+    if (emu->mapper.map_cpu_pages)
+        emu->mapper.map_cpu_pages(&emu->mapper, cpu->read_pages, cpu->write_pages);
+
+    // Decoded instructions are only valid for the bank they were decoded from
+    for (int page = 0x80; page < 0x100; page++) {
+        if (cpu->read_pages[page] != mapped[page] || cpu->write_pages[page])
+            memset(&cpu->decode_cache[(page << 8) & 0x7FFF], 0, 256 * sizeof(Decoded_op));
+    }
+    jit_flush(emu);
+}
+
+void execute_cpu_ppu(Emulator *emu) {
+    // Single step, a budget event on the next cycle stops the loop after one instruction
+    schedule_event(emu, EVENT_RUN_BUDGET, emu->cycles + 1, NULL);
+    execute_instructions(emu);
+    cancel_event(emu, EVENT_RUN_BUDGET);
+    if (emu->cycles >= emu->scheduler.next_event_cycle) run_due_events(emu);
+}
+
+Byte get_status(const CPU *cpu) {
+    Byte status = cpu->P;
+    status |= cpu->n_result & FLAG_N;
+    status |= (cpu->v_result & 0x80) ? FLAG_V : 0;
+    status |= (cpu->z_result) ? 0 : FLAG_Z;
+    return status;
+}
+
+void set_status(CPU *cpu, Byte status) {
+    cpu->P = status & (FLAG_C | FLAG_I | FLAG_D | FLAG_B);
+    cpu->n_result = status;
+    cpu->v_result = status << 1;
+    cpu->z_result = ~status & FLAG_Z;
+}
+
+void request_nmi(Emulator *emu) {
+    schedule_event(emu, EVENT_NMI, emu->cycles, cpu_nmi_event);
+}
+
+void set_irq_line(Emulator *emu, Byte source, bool asserted) {
+    if (asserted) emu->cpu.irq_line |= source;
+    else emu->cpu.irq_line &= ~source;
+    poll_irq(emu);
+}
+
+void poll_irq(Emulator *emu) {
+    // Level triggered, taken at the next instruction boundary while the I flag is clear
+    if (emu->cpu.irq_line && !(emu->cpu.P & FLAG_I))
+        schedule_event(emu, EVENT_IRQ, emu->cycles, cpu_irq_event);
+}
+
+void cpu_nmi_event(Emulator *emu) {
+    if (emu->ppu.create_nmi && emu->ppu.PPUCTRL.Generate_NMI) {
+        emu->ppu.create_nmi = false;
+        cpu_nmi(emu);
     }
 }
 
-void exit_cpu(void) {
-    if (p_mapper)
-        free_cartridge(p_mapper);
+void cpu_irq_event(Emulator *emu) {
+    if (emu->cpu.irq_line && !(emu->cpu.P & FLAG_I))
+        cpu_irq(emu);
 }
 
+int64_t run_cycles(Emulator *emu, int64_t cycles) {
+    int64_t start = emu->cycles;
+    // Instructions are never split, so the overshoot of the last call is paid back here
+    int64_t target = start + cycles - emu->cycle_overshoot;
+    schedule_event(emu, EVENT_RUN_BUDGET, target, NULL);
+    while (emu->cycles < target) {
+        emu->execute(emu);
+        run_due_events(emu);
+    }
+    cancel_event(emu, EVENT_RUN_BUDGET);
+    sync_ppu(emu);
+    emu->cycle_overshoot = emu->cycles - target;
+    return emu->cycles - start;
+}
+
+int64_t run_frame(Emulator *emu) {
+    // Frame length is decided by the PPU (341 x 262 dots with one dot skipped on odd
+    // rendered frames), which averages the 29780.5 CPU cycles per frame without rounding
+    int64_t start = emu->cycles;
+    emu->ppu.frame_complete = false;
+    while (!emu->ppu.frame_complete) {
+        emu->execute(emu);
+        run_due_events(emu);
+    }
+    return emu->cycles - start;
+}
+
+bool set_cpu_backend(Emulator *emu, enum Cpu_backend backend) {
+    if (backend == CPU_JIT && !init_jit(emu))
+        return false;
+    emu->execute = (backend == CPU_JIT) ? execute_jit : execute_instructions;
+    return true;
+}
+
+void exit_cpu(Emulator *emu) {
+    exit_jit(emu);
+    free_cartridge(&emu->mapper);
+}
@@ -1,12 +1,47 @@
 #ifndef CPU_6502_H
 #define CPU_6502_H
 
+#include <stdbool.h>
+
 #include "../../types.h"
 
 #define NOT_ENOUGH_CYCLES 0
 
 #define MEM_SIZE 0x10000        // 65536 B = 1024 * 64 B = 64 kB 
 
+// Sources sharing the CPU IRQ line
+enum Irq_source {
+    IRQ_APU_FRAME = 0x1,
+    IRQ_DMC = 0x2,
+    IRQ_MAPPER = 0x4
+};
+
+// Status register bits, NV-BDIZC
+enum Status_flag {
+    FLAG_C = 0x01,
+    FLAG_Z = 0x02,
+    FLAG_I = 0x04,
+    FLAG_D = 0x08,
+    FLAG_B = 0x10,
+    FLAG_U = 0x20,              // Unused, only set in the copy PHP pushes
+    FLAG_V = 0x40,
+    FLAG_N = 0x80
+};
+
+// Engines behind run_frame() and run_cycles()
+enum Cpu_backend {
+    CPU_INTERPRETER,
+    CPU_JIT                     // x86-64 recompiler for hot PRG-ROM blocks, see jit.h
+};
+
+// One instruction of a PRG page, decoded ahead of running it
+typedef struct {
+    Byte op_code;
+    Byte size;                  // Instruction bytes, 0 while the address is not decoded
+    Word operand;               // Operand bytes, little endian
+    Word handler;               // op_code, or 0x100 + a FUSED_TABLE index when the next instruction is fused in
+} Decoded_op;
+
 typedef struct {
     Byte RAM[2048];             // 2KB of RAM ->		$0000 - $07FF
     Byte APU_registers[18];     // APU registers ->		$4000 - $4017
@@ -19,32 +54,59 @@ typedef struct CPU {
     // Registers
     Byte A, X, Y;
 
-    // Status Flags
-    Byte C : 1; // Carry flag
-    Byte Z : 1; // Zero flag
-    Byte I : 1; // Interrupt Disble
-    Byte D : 1; // Decimal mode
-    Byte B : 1; // Break command
-    Byte V : 1; // Overfloaw flag
-    Byte N : 1; // Negative flag
+    // Status Flags, C, I, D and B are packed in P. N, V and Z are evaluated lazily from the
+    // last result that set them, get_status() folds everything into one NV-BDIZC byte
+    Byte P;
+    Byte n_result;              // N is bit 7
+    Byte v_result;              // V is bit 7
+    Byte z_result;              // Z is set while this is 0
 
     // Bus
     CPU_Bus Bus;
+    Byte irq_line;              // Asserted Irq_source bits
+
+    // Memory map, one entry per 256 byte page. Pages without host memory behind
+    // them (PPU, APU / IO and mapper registers) are NULL and trap to the I/O handlers
+    Byte *read_pages[256];
+    Byte *write_pages[256];
 
-    // Helper variables
-    Byte temp_byte;
-    Word temp_word;
-    Byte current_mode;
+    // Instructions decoded from the read-only pages at $8000 - $FFFF, indexed by address - $8000
+    Decoded_op decode_cache[0x8000];
 } CPU;
 
-void reset_cpu(void);
+void reset_cpu(Emulator *emu);
+
+// Maps the memory pages and nametables, schedules the first PPU events and loads PC from the reset vector
+void init_cpu(Emulator *emu);
+
+void map_cpu_pages(Emulator *emu);
+
+Byte get_status(const CPU *cpu);
+
+void set_status(CPU *cpu, Byte status);
+
+void execute_cpu_ppu(Emulator *emu);
+
+int64_t run_cycles(Emulator *emu, int64_t cycles);
+
+int64_t run_frame(Emulator *emu);
+
+int cpu_clock(Emulator *emu);
+
+void request_nmi(Emulator *emu);
+
+void set_irq_line(Emulator *emu, Byte source, bool asserted);
+
+void poll_irq(Emulator *emu);
 
-void init_cpu(int64_t *cycles);
+// Scheduler callbacks of EVENT_NMI and EVENT_IRQ
+void cpu_nmi_event(Emulator *emu);
 
-void execute_cpu_ppu(void);
+void cpu_irq_event(Emulator *emu);
 
-int cpu_clock(void);
+// Interpreter by default, false when the JIT can't run on this host
+bool set_cpu_backend(Emulator *emu, enum Cpu_backend backend);
 
-void exit_cpu(void);
+void exit_cpu(Emulator *emu);
 
 #endif //CPU_6502_H
@@ -1,926 +1,758 @@
-#include "../global.h"
+#include "../emulator.h"
 #include "instructions.h"
+#include "opcodes.h"
 
 /*Helper functions */
 
-static Byte cpu_read_byte(Word address);
-static Byte cpu_write_byte(Word address, Byte data);
-static void stack_push(Byte data);
-static Byte stack_pop(void);
-static void _set_status_A(void);
-static void _check_page_crossed(void);
+static void stack_push(CPU *cpu, Byte data);
+static Byte cpu_read_io(Emulator *emu, Word address);
+static void cpu_write_io(Emulator *emu, Word address, Byte data);
 
-Byte fetch_byte(void) {
-    Word counter = p_cpu->PC;
-    p_cpu->PC = (counter == 0xFFFF) ? 0x8000 : counter + 1;
-    Byte data = 0x00;
-    if (counter >= 0x4020)
-        data = p_mapper->cpu_read(p_mapper, counter);
-    return data;
+Byte fetch_byte(Emulator *emu) {
+    Word counter = emu->cpu.PC;
+    emu->cpu.PC = (counter == 0xFFFF) ? 0x8000 : counter + 1;
+    return cpu_read_byte(emu, counter);
 }
 
-Word fetch_word(void) {
-    Word counter = p_cpu->PC;
-    Word data = 0x0000;
-    p_cpu->PC = (counter == 0xFFFF) ? 0x8001 : counter + 2;
-    if (counter >= 0x4020) {
-        data = (Word) p_mapper->cpu_read(p_mapper, counter);
-        cpu_clock();
-        data |= ((Word) p_mapper->cpu_read(p_mapper, counter + 1)) << 8;
-    }
+Word fetch_word(Emulator *emu) {
+    Word counter = emu->cpu.PC;
+    emu->cpu.PC = (counter == 0xFFFF) ? 0x8001 : counter + 2;
+    Word data = (Word) cpu_read_byte(emu, counter);
+    cpu_clock(emu);
+    data |= ((Word) cpu_read_byte(emu, counter + 1)) << 8;
     return data;
 }
 
-static Byte cpu_read_byte(Word address) {
-    Byte data = 0x00;
-    // Address inside CPU RAM
-    if (address <= 0x1FFF)
-        data = p_cpu->Bus.RAM[address & 0x07FF];    // 2KB of RAM mirrored across 8KB
-
-    // Address inside PPU registers
-    else if (address >= 0x2000 && address <= 0x3FFF)
-        data = cpu_to_ppu_read(address);            // Reading on the ppu registers
-
-        // Address inside cartridge
-    else
-        data = p_mapper->cpu_read(p_mapper, address);
-
-    return data;
+Byte cpu_read_byte(Emulator *emu, Word address) {
+    // RAM and PRG-ROM pages are plain host memory
+    Byte *page = emu->cpu.read_pages[address >> 8];
+    if (page)
+        return page[address & 0xFF];
+    return cpu_read_io(emu, address);
 }
 
-static Byte cpu_write_byte(Word address, Byte data) {
-    // Address inside CPU RAM
-    if (address <= 0x1FFF)
-        p_cpu->Bus.RAM[address & 0x07FF] = data;         // 2KB of RAM mirrored across 8KB
-
-        // Address inside PPU registers
-    else if (address >= 0x2000 && address <= 0x3FFF)
-        cpu_to_ppu_write(address, data);    // Writting on the ppu registers
-
-        // Address inside cartridge
+Byte cpu_write_byte(Emulator *emu, Word address, Byte data) {
+    Byte *page = emu->cpu.write_pages[address >> 8];
+    if (page)
+        page[address & 0xFF] = data;
     else
-        p_mapper->cpu_write(p_mapper, address, data);
-
-    return 0;
-}
-
-static void stack_push(Byte data) {
-    p_cpu->Bus.RAM[p_cpu->SP] = data;
-    p_cpu->SP = (p_cpu->SP == 0x0100) ? 0x01FF : p_cpu->SP - 1;
-}
-
-static Byte stack_pop(void) {
-    p_cpu->SP = (p_cpu->SP == 0x01FF) ? 0x0100 : p_cpu->SP + 1;
-    return p_cpu->Bus.RAM[p_cpu->SP];
-}
-
-static void _set_status_A(void) {
-    p_cpu->Z = (p_cpu->A == 0); // Zero flag is set if A is Zero
-    p_cpu->N = (p_cpu->A & 0b10000000) ? 1 : 0;
-}
-
-static void _check_page_crossed(void) {
-    if ((p_cpu->PC & 0xFF00) == (p_cpu->temp_word & 0xFF00))
-        cpu_clock();
-    else {
-        cpu_clock();
-        cpu_clock();
-    }
-    p_cpu->PC = p_cpu->temp_word;
-}
-
-void cpu_irq(void) {
-    if (!(p_cpu->I)) {
-        p_cpu->PC += 1;
-        cpu_clock();
-        stack_push((Byte) (p_cpu->PC >> 8));
-        cpu_clock();
-        stack_push((Byte) p_cpu->PC);
-        cpu_clock();
-        Byte SR = 0;
-        SR |= (p_cpu->N) ? 0x80 : 0;
-        SR |= (p_cpu->V) ? 0x40 : 0;
-        SR |= (p_cpu->D) ? 0x8 : 0;
-        SR |= (p_cpu->I) ? 0x4 : 0;
-        SR |= (p_cpu->Z) ? 0x2 : 0;
-        SR |= (p_cpu->C) ? 0x1 : 0;
-        stack_push(SR);
-        cpu_clock();
-        p_cpu->I = 1;
-        Word new_address = cpu_read_byte(0xFFFE);
-        cpu_clock();
-        new_address |= ((Word) cpu_read_byte(0xFFFF)) << 8;
-        p_cpu->PC = new_address;
-        cpu_clock();
-    }
-}
-
-void cpu_nmi(void) {
-    p_cpu->PC += 1;
-    cpu_clock();
-    stack_push((Byte) (p_cpu->PC >> 8));
-    cpu_clock();
-    stack_push((Byte) p_cpu->PC);
-    cpu_clock();
-    Byte SR = 0;
-    SR |= (p_cpu->N) ? 0x80 : 0;
-    SR |= (p_cpu->V) ? 0x40 : 0;
-    SR |= (p_cpu->D) ? 0x8 : 0;
-    SR |= (p_cpu->I) ? 0x4 : 0;
-    SR |= (p_cpu->Z) ? 0x2 : 0;
-    SR |= (p_cpu->C) ? 0x1 : 0;
-    stack_push(SR);
-    cpu_clock();
-    p_cpu->I = 1;
-    Word new_address = cpu_read_byte(0xFFFA);
-    cpu_clock();
-    new_address |= ((Word) cpu_read_byte(0xFFFB)) << 8;
-    p_cpu->PC = new_address;
-    cpu_clock();
-}
-
-const Ins ins_table[256] = {
-    /*\--- 0 ---\ \--- 1 ---\ \--- 2 ---\ \--- 3 ---\ \--- 4 ---\ \--- 5 ---\ \--- 6 ---\ \--- 7 ---\ \--- 8 ---\ \--- 9 ---\ \--- A ---\ \--- B ---\ \--- C ---\ \--- D ---\ \--- E ---\ \--- F ---\*/
-    /*= 0 =*/    {IMP, BRK}, {IZX, ORA}, {NUL, NUL}, {NUL, NUL}, {NUL, NUL}, {ZP0, ORA}, {ZP0, ASL}, {NUL, NUL}, {IMP, PHP}, {IMM, ORA}, {ACC, ASL}, {NUL, NUL}, {NUL, NUL}, {ABS, ORA}, {ABS, ASL}, {NUL, NUL},
-    /*= 1 =*/    {REL, BPL}, {IZY, ORA}, {NUL, NUL}, {NUL, NUL}, {NUL, NUL}, {ZPX, ORA}, {ZPX, ASL}, {NUL, NUL}, {IMP, CLC}, {ABX, ORA}, {NUL, NUL}, {NUL, NUL}, {NUL, NUL}, {ABX, ORA}, {ABX, ASL}, {NUL, NUL},
-    /*= 2 =*/    {ABS, JSR}, {IZX, AND}, {NUL, NUL}, {NUL, NUL}, {ZP0, BIT}, {ZP0, AND}, {ZP0, ROL}, {NUL, NUL}, {IMP, PLP}, {IMM, AND}, {ACC, ROL}, {NUL, NUL}, {ABS, BIT}, {ABS, AND}, {ABS, ROL}, {NUL, NUL},
-    /*= 3 =*/    {REL, BMI}, {IZY, AND}, {NUL, NUL}, {NUL, NUL}, {NUL, NUL}, {ZPX, AND}, {ZPX, ROL}, {NUL, NUL}, {IMP, SEC}, {ABY, AND}, {NUL, NUL}, {NUL, NUL}, {NUL, NUL}, {ABX, AND}, {ABX, ROL}, {NUL, NUL},
-    /*= 4 =*/    {IMP, RTI}, {IZX, EOR}, {NUL, NUL}, {NUL, NUL}, {NUL, NUL}, {ZP0, EOR}, {ZP0, LSR}, {NUL, NUL}, {IMP, PHA}, {IMM, EOR}, {ACC, LSR}, {NUL, NUL}, {ABS, JMP}, {ABS, EOR}, {ABS, LSR}, {NUL, NUL},
-    /*= 5 =*/    {REL, BVC}, {IZY, EOR}, {NUL, NUL}, {NUL, NUL}, {NUL, NUL}, {ZPX, EOR}, {ZPX, LSR}, {NUL, NUL}, {IMP, CLI}, {ABY, EOR}, {NUL, NUL}, {NUL, NUL}, {NUL, NUL}, {ABX, EOR}, {ABX, LSR}, {NUL, NUL},
-    /*= 6 =*/    {IMP, RTS}, {IZX, ADC}, {NUL, NUL}, {NUL, NUL}, {NUL, NUL}, {ZP0, ADC}, {ZP0, ROR}, {NUL, NUL}, {IMP, PLA}, {IMM, ADC}, {ACC, ROR}, {NUL, NUL}, {IND, JMP}, {ABS, ADC}, {ABS, ROR}, {NUL, NUL},
-    /*= 7 =*/    {REL, BVS}, {IZY, ADC}, {NUL, NUL}, {NUL, NUL}, {NUL, NUL}, {ZPX, ADC}, {ZPX, ROR}, {NUL, NUL}, {IMP, SEI}, {ABY, ADC}, {NUL, NUL}, {NUL, NUL}, {NUL, NUL}, {ABX, ADC}, {ABX, ROR}, {NUL, NUL},
-    /*= 8 =*/    {NUL, NUL}, {IZX, STA}, {NUL, NUL}, {NUL, NUL}, {ZP0, STY}, {ZP0, STA}, {ZP0, STX}, {NUL, NUL}, {IMP, DEY}, {NUL, NUL}, {IMP, TXA}, {NUL, NUL}, {ABS, STY}, {ABS, STA}, {ABS, STX}, {NUL, NUL},
-    /*= 9 =*/    {REL, BCC}, {IZY, STA}, {NUL, NUL}, {NUL, NUL}, {ZPX, STY}, {ZPX, STA}, {ZPY, STX}, {NUL, NUL}, {IMP, TYA}, {ABY, STA}, {IMP, TXS}, {NUL, NUL}, {NUL, NUL}, {ABX, STA}, {NUL, NUL}, {NUL, NUL},
-    /*= A =*/    {IMM, LDY}, {IZX, LDA}, {IMM, LDX}, {NUL, NUL}, {ZP0, LDY}, {ZP0, LDA}, {ZP0, LDX}, {NUL, NUL}, {IMP, TAY}, {IMM, LDA}, {IMP, TAX}, {NUL, NUL}, {ABS, LDY}, {ABS, LDA}, {ABS, LDX}, {NUL, NUL},
-    /*= B =*/    {REL, BCS}, {IZY, LDA}, {NUL, NUL}, {NUL, NUL}, {ZPX, LDY}, {ZPX, LDA}, {ZPY, LDX}, {NUL, NUL}, {IMP, CLV}, {ABY, LDA}, {IMP, TSX}, {NUL, NUL}, {ABX, LDY}, {ABX, LDA}, {ABY, LDX}, {NUL, NUL},
-    /*= C =*/    {IMM, CPY}, {IZX, CMP}, {NUL, NUL}, {NUL, NUL}, {ZP0, CPY}, {ZP0, CMP}, {ZP0, DEC}, {NUL, NUL}, {IMP, INY}, {IMM, CMP}, {IMP, DEX}, {NUL, NUL}, {ABS, CPY}, {ABS, CMP}, {ABS, DEC}, {NUL, NUL},
-    /*= D =*/    {REL, BNE}, {IZY, CMP}, {NUL, NUL}, {NUL, NUL}, {NUL, NUL}, {ZPX, CMP}, {ZPX, DEC}, {NUL, NUL}, {IMP, CLD}, {ABY, CMP}, {NUL, NUL}, {NUL, NUL}, {NUL, NUL}, {ABX, CMP}, {ABX, DEC}, {NUL, NUL},
-    /*= E =*/    {IMM, CPX}, {IZX, SBC}, {NUL, NUL}, {NUL, NUL}, {ZP0, CPX}, {ZP0, SBC}, {ZP0, INC}, {NUL, NUL}, {IMP, INX}, {IMM, SBC}, {IMP, NOP}, {NUL, NUL}, {ABS, CPX}, {ABS, SBC}, {ABS, INC}, {NUL, NUL},
-    /*= F =*/    {REL, BEQ}, {IZY, SBC}, {NUL, NUL}, {NUL, NUL}, {NUL, NUL}, {ZPX, SBC}, {ZPX, INC}, {NUL, NUL}, {IMP, SED}, {ABY, SBC}, {NUL, NUL}, {NUL, NUL}, {NUL, NUL}, {ABX, SBC}, {ABX, INC}, {NUL, NUL}
-};
-
-/*Addressing modes*/
-
-Byte ABS(void) {
-    Word data_address = fetch_word();
-    p_cpu->temp_word = data_address;
-    p_cpu->current_mode = 1;
-    return 0;
-}
-
-Byte ABX(void) {
-    Word data_address = fetch_word();
-    cpu_clock();
-    Word data_address_x = data_address + p_cpu->X;
-    p_cpu->temp_word = data_address_x;
-    p_cpu->current_mode = 2;
-    if ((data_address & 0xFF00) == (data_address_x & 0xFF00))
-        return 0;
-    else{
-        cpu_clock();
-        return 1;
-    }
-}
-
-Byte ABY(void) {
-    Word data_address = fetch_word();
-    cpu_clock();
-    Word data_address_y = data_address + p_cpu->Y;
-    p_cpu->temp_word = data_address_y;
-    p_cpu->current_mode = 3;
-    if ((data_address & 0xFF00) == (data_address_y & 0xFF00))
-        return 0;
-    else{
-        cpu_clock();
-        return 1;
-    }
-}
-
-Byte ACC(void) {
-    p_cpu->temp_byte = p_cpu->A;
-    p_cpu->current_mode = 4;
-    return 0;
-}
-
-Byte IMP(void) {
-    p_cpu->current_mode = 5;
+        cpu_write_io(emu, address, data);
     return 0;
 }
 
-Byte IMM(void) {
-    p_cpu->temp_byte = fetch_byte();
-    p_cpu->current_mode = 6;
-    return 0;
-}
-
-Byte IND(void) {
-    Word data_address = fetch_word();
-    Byte byte_data = cpu_read_byte(data_address);
-    cpu_clock();
-    Word word_data = 0;
-
-    if ((data_address & 0x00FF) == 0x00FF) {
-        word_data = (((Word) cpu_read_byte(data_address & 0xFF00)) << 8) | ((Word) byte_data);
-        cpu_clock();
+static Byte cpu_read_io(Emulator *emu, Word address) {
+    Byte data = 0x00;
+    // Address inside PPU registers
+    if (address >= 0x2000 && address <= 0x3FFF) {
+        sync_ppu(emu);
+        data = cpu_to_ppu_read(emu, address);       // Reading on the ppu registers
     }
+    // Controller ports
+    else if (address == 0x4016 || address == 0x4017)
+        data = read_controller(emu, address & 0x1);
+        // Address inside APU / IO registers or cartridge
     else {
-        word_data = (((Word) cpu_read_byte(data_address + 1)) << 8) | ((Word) byte_data);
-        cpu_clock();
+        PROFILE_BEGIN(start);
+        data = emu->mapper.cpu_read(&emu->mapper, address);
+        PROFILE_END(start, emu->profile.mapper_ticks);
     }
-    p_cpu->temp_word = word_data;
-    p_cpu->temp_byte = cpu_read_byte(word_data);
-    p_cpu->current_mode = 7;
-    return 0;
-}
 
-Byte IZX(void) {
-    Byte zp_data_address_x = fetch_byte();
-    cpu_clock();
-    zp_data_address_x += p_cpu->X;
-    Word full_zp_address_x = (Word) zp_data_address_x;
-    cpu_clock();
-    Byte byte_data = cpu_read_byte(full_zp_address_x);
-    cpu_clock();
-    Word word_data = (((Word) cpu_read_byte(full_zp_address_x + 1)) << 8) | ((Word) byte_data);
-    cpu_clock();
-    p_cpu->temp_word = word_data;
-    p_cpu->temp_byte = cpu_read_byte(word_data);
-    p_cpu->current_mode = 8;
-    return 0;
-}
-
-Byte IZY(void) {
-    Byte zp_data_address_y = fetch_byte();
-    cpu_clock();
-    Word full_zp_address_y = (Word) zp_data_address_y;
-    Byte byte_data = cpu_read_byte(full_zp_address_y);
-    cpu_clock();
-    Word word_data = (((Word) cpu_read_byte(full_zp_address_y + 1)) << 8) | ((Word) byte_data);
-    cpu_clock();
-    Word temp_word_data = (Word) p_cpu->Y + word_data;
-    p_cpu->temp_word = temp_word_data;
-    p_cpu->temp_byte = cpu_read_byte(temp_word_data);
-    p_cpu->current_mode = 9;
-    if ((temp_word_data & 0xFF00) == (word_data & 0xFF00))
-        return 0;
-    else {
-        cpu_clock();
-        return 1;
-    }
-}
-
-Byte REL(void) {
-    Byte byte_offset = fetch_byte();
-    p_cpu->temp_byte = byte_offset;
-    Word target = p_cpu->PC;
-    target += (int8_t) byte_offset;
-
-    p_cpu->temp_word = target;
-    p_cpu->current_mode = 10;
-    return 0;
-}
-
-Byte ZP0(void) {
-    Byte zero_page_address = fetch_byte();
-    cpu_clock();
-    p_cpu->temp_word = (Word) zero_page_address;
-    p_cpu->temp_byte = cpu_read_byte((Word) zero_page_address);
-    p_cpu->current_mode = 11;
-    return 0;
-}
-
-Byte ZPX(void) {
-    Byte zero_page_address_x = fetch_byte();
-    cpu_clock();
-    zero_page_address_x += p_cpu->X;
-    p_cpu->temp_word = (Word) zero_page_address_x;
-    cpu_clock();
-    p_cpu->temp_byte = cpu_read_byte((Word) zero_page_address_x);
-    p_cpu->current_mode = 12;
-    return 0;
-}
-
-Byte ZPY(void) {
-    Byte zero_page_address_y = fetch_byte();
-    cpu_clock();
-    zero_page_address_y += p_cpu->Y;
-    p_cpu->temp_word = (Word) zero_page_address_y;
-    cpu_clock();
-    p_cpu->temp_byte = cpu_read_byte((Word) zero_page_address_y);
-    p_cpu->current_mode = 13;
-    return 0;
-}
-
-/*Operation functions*/
-
-Byte ADC(void) {
-    if (p_cpu->current_mode == 1 || p_cpu->current_mode == 2 || p_cpu->current_mode == 3) p_cpu->temp_byte = cpu_read_byte(p_cpu->temp_word);
-    Word acc = (Word) p_cpu->A;
-    Word tmp_byte = (Word) p_cpu->temp_byte;
-    Word temp_sum = acc + tmp_byte + p_cpu->C;
-
-    p_cpu->A = (Byte) temp_sum;
-    if (p_cpu->current_mode == 1)
-        cpu_clock();
-    p_cpu->C = (temp_sum > 256) ? 1 : 0;
-    p_cpu->Z = (temp_sum == 0) ? 1 : 0;
-    p_cpu->V = (~(acc ^ tmp_byte) & (acc ^ temp_sum) & 0x80) ? 1 : 0;
-    p_cpu->N = (temp_sum & 0x80) ? 1 : 0;
-    cpu_clock();
-    return 0;
-}
-
-Byte AND(void){
-    if (p_cpu->current_mode == 1 || p_cpu->current_mode == 2 || p_cpu->current_mode == 3) p_cpu->temp_byte = cpu_read_byte(p_cpu->temp_word);
-    if (p_cpu->current_mode == 1)
-        cpu_clock();
-    p_cpu->A &= p_cpu->temp_byte;
-    p_cpu->Z = (p_cpu->A == 0) ? 1 : 0;
-    p_cpu->N = (p_cpu->A & 0x80) ? 1 : 0;
-    cpu_clock();
-    return 0;
+    return data;
 }
 
-Byte ASL(void){
-    if (p_cpu->current_mode == 4){
-        p_cpu->C = (p_cpu->A & 0x80) ? 1 : 0;
-        p_cpu->A <<= 1;
-        p_cpu->Z = (p_cpu->A == 0) ? 1 : 0;
-        p_cpu->N = (p_cpu->A & 0x80) ? 1 : 0;
+static void cpu_write_io(Emulator *emu, Word address, Byte data) {
+    // Address inside PPU registers
+    if (address >= 0x2000 && address <= 0x3FFF) {
+        sync_ppu(emu);
+        cpu_to_ppu_write(emu, address, data);   // Writting on the ppu registers
     }
+    // Controller strobe, $4017 writes belong to the APU frame counter
+    else if (address == 0x4016)
+        write_controller_strobe(emu, data);
+        // Address inside cartridge
     else {
-        if (p_cpu->current_mode == 1 || p_cpu->current_mode == 2 || p_cpu->current_mode == 3) p_cpu->temp_byte = cpu_read_byte(p_cpu->temp_word);
-        p_cpu->C = (p_cpu->temp_byte & 0x80) ? 1 : 0;
-        cpu_clock();
-        p_cpu->temp_byte >>= 1;
-        cpu_clock();
-        p_cpu->Z = (p_cpu->temp_byte == 0) ? 1 : 0;
-        p_cpu->N = (p_cpu->temp_byte & 0x80) ? 1 : 0;
-        if (p_cpu->current_mode == 1 || p_cpu->current_mode == 2)
-            cpu_clock();
-        cpu_write_byte(p_cpu->temp_word, p_cpu->temp_byte);
+        sync_ppu(emu);                      // Mapper writes can switch what the PPU fetches
+        flush_scanline(emu);
+        enum Mirror_type mirroring = emu->mapper.mirroring;
+        PROFILE_BEGIN(start);
+        emu->mapper.cpu_write(&emu->mapper, address, data);
+        PROFILE_END(start, emu->profile.mapper_ticks);
+        if (emu->mapper.mirroring != mirroring) map_nametables(emu);
     }
-    cpu_clock();
-    return 0;
-}
-
-Byte BCC(void){
-    if (!p_cpu->C)
-        _check_page_crossed();
-    cpu_clock();
-    return 0;
-}
-
-Byte BCS(void){
-    if (p_cpu->C)
-        _check_page_crossed();
-    cpu_clock();
-    return 0;
-}
-
-Byte BEQ(void){
-    if (p_cpu->Z)
-        _check_page_crossed();
-
-    cpu_clock();
-    return 0;
-}
-
-Byte BIT(void){
-    if (p_cpu->current_mode == 1)
-        cpu_clock();
-    if (p_cpu->current_mode == 1 || p_cpu->current_mode == 2 || p_cpu->current_mode == 3) p_cpu->temp_byte = cpu_read_byte(p_cpu->temp_word);
-    p_cpu->N = (p_cpu->temp_byte & 0b10000000) ? 1 : 0;
-    p_cpu->V = (p_cpu->temp_byte & 0b01000000) ? 1 : 0;
-    p_cpu->Z = (p_cpu->temp_byte & p_cpu->A) ? 0 : 1;
-    cpu_clock();
-    return 0;
-}
-
-Byte BMI(void){
-    if (p_cpu->N)
-        _check_page_crossed();
-    cpu_clock();
-    return 0;
-}
-
-Byte BNE(void){
-    if (!p_cpu->Z)
-        _check_page_crossed();
-    cpu_clock();
-    return 0;
-}
-
-Byte BPL(void){
-    if (!p_cpu->N)
-        p_cpu->PC = p_cpu->temp_word;
-    cpu_clock();
-    return 0;
-}
-
-Byte BRK(void){
-    p_cpu->PC += 1;
-    stack_push((Byte) (p_cpu->PC >> 8));
-    cpu_clock();
-    stack_push((Byte) (p_cpu->PC));
-    cpu_clock();
-    Byte SR = 0;
-    SR |= (p_cpu->N) ? 0x80 : 0;
-    SR |= (p_cpu->V) ? 0x40 : 0;
-    SR |= 0x10;
-    SR |= (p_cpu->D) ? 0x8 : 0;
-    SR |= (p_cpu->I) ? 0x4 : 0;
-    SR |= (p_cpu->Z) ? 0x2 : 0;
-    SR |= (p_cpu->C) ? 0x1 : 0;
-    stack_push(SR);
-    cpu_clock();
-    p_cpu->I = 1;
-    cpu_clock();
-    Word new_address = cpu_read_byte(0xFFFE);
-    cpu_clock();
-    new_address |= ((Word) cpu_read_byte(0xFFFF)) << 8;
-    p_cpu->PC = new_address;
-    cpu_clock();
-    return 0;
-}
-
-Byte BVC(void){
-    if (!p_cpu->V)
-        _check_page_crossed();
-    cpu_clock();
-    return 0;
-}
-
-Byte BVS(void){
-    if (p_cpu->V)
-        _check_page_crossed();
-    cpu_clock();
-    return 0;
 }
 
-Byte CLC(void){
-    p_cpu->C = 0;
-    cpu_clock();
-    return 0;
-}
-
-Byte CLD(void){
-    p_cpu->D = 0;
-    cpu_clock();
-    return 0;
+static void stack_push(CPU *cpu, Byte data) {
+    cpu->Bus.RAM[cpu->SP] = data;
+    cpu->SP = (cpu->SP == 0x0100) ? 0x01FF : cpu->SP - 1;
+}
+
+void cpu_irq(Emulator *emu) {
+    CPU *cpu = &emu->cpu;
+    if (!(cpu->P & FLAG_I)) {
+        cpu->PC += 1;
+        cpu_clock(emu);
+        stack_push(cpu, (Byte) (cpu->PC >> 8));
+        cpu_clock(emu);
+        stack_push(cpu, (Byte) cpu->PC);
+        cpu_clock(emu);
+        stack_push(cpu, get_status(cpu) & ~FLAG_B);
+        cpu_clock(emu);
+        cpu->P |= FLAG_I;
+        Word new_address = cpu_read_byte(emu, 0xFFFE);
+        cpu_clock(emu);
+        new_address |= ((Word) cpu_read_byte(emu, 0xFFFF)) << 8;
+        cpu->PC = new_address;
+        cpu_clock(emu);
+    }
 }
 
-Byte CLI(void){
-    p_cpu->I = 0;
-    cpu_clock();
-    return 0;
-}
+void cpu_nmi(Emulator *emu) {
+    CPU *cpu = &emu->cpu;
+    cpu->PC += 1;
+    cpu_clock(emu);
+    stack_push(cpu, (Byte) (cpu->PC >> 8));
+    cpu_clock(emu);
+    stack_push(cpu, (Byte) cpu->PC);
+    cpu_clock(emu);
+    stack_push(cpu, get_status(cpu) & ~FLAG_B);
+    cpu_clock(emu);
+    cpu->P |= FLAG_I;
+    Word new_address = cpu_read_byte(emu, 0xFFFA);
+    cpu_clock(emu);
+    new_address |= ((Word) cpu_read_byte(emu, 0xFFFB)) << 8;
+    cpu->PC = new_address;
+    cpu_clock(emu);
+}
+
+/*Interpreter*/
+
+/* Addressing modes, a constant at every opcode so the mode checks in the operations fold away */
+#define M_ABS 1
+#define M_ABX 2
+#define M_ABY 3
+#define M_ACC 4
+#define M_IMP 5
+#define M_IMM 6
+#define M_IND 7
+#define M_IZX 8
+#define M_IZY 9
+#define M_REL 10
+#define M_ZP0 11
+#define M_ZPX 12
+#define M_ZPY 13
+
+// Instruction bytes per addressing mode
+#define SIZE_ABS 3
+#define SIZE_ABX 3
+#define SIZE_ABY 3
+#define SIZE_ACC 1
+#define SIZE_IMP 1
+#define SIZE_IMM 2
+#define SIZE_IND 3
+#define SIZE_IZX 2
+#define SIZE_IZY 2
+#define SIZE_REL 2
+#define SIZE_ZP0 2
+#define SIZE_ZPX 2
+#define SIZE_ZPY 2
+
+/* Opcode table columns for decoding outside the handlers, 0 for illegal opcodes */
+#define MODE_ENTRY(hex, mode, operation, base, page_penalty, class) [0x##hex] = M_##mode,
+#define SIZE_ENTRY(hex, mode, operation, base, page_penalty, class) [0x##hex] = SIZE_##mode,
+#define CLASS_ENTRY(hex, mode, operation, base, page_penalty, class) [0x##hex] = CLASS_##class,
+#define BASE_ENTRY(hex, mode, operation, base, page_penalty, class) [0x##hex] = (base),
+
+static const Byte opcode_modes[256] = { OPCODE_TABLE(MODE_ENTRY) };
+static const Byte opcode_sizes[256] = { OPCODE_TABLE(SIZE_ENTRY) };
+static const Byte opcode_classes[256] = { OPCODE_TABLE(CLASS_ENTRY) };
+static const Byte opcode_cycles[256] = { OPCODE_TABLE(BASE_ENTRY) };
+
+/* Superinstructions, decode_block() gives the first instruction of a FUSED_TABLE pair the fused handler */
+#define FUSED_ID(first, first_mode, first_operation, first_base, first_penalty, first_class,            \
+                 second, second_mode, second_operation, second_base, second_penalty, second_class)     \
+    FUSED_##first##_##second,
+#define FUSED_PAIR(first, first_mode, first_operation, first_base, first_penalty, first_class,          \
+                   second, second_mode, second_operation, second_base, second_penalty, second_class)   \
+    {0x##first, 0x##second},
+
+enum { FUSED_TABLE(FUSED_ID) FUSED_COUNT };
+
+static const Byte fused_pairs[FUSED_COUNT][2] = { FUSED_TABLE(FUSED_PAIR) };
+
+/* The fused handlers paste the FUSED_TABLE columns, they can't be looked up from OPCODE_TABLE by opcode.
+   Every OPCODE_TABLE row names a constant instead, a fused row that differs from its opcodes' rows names
+   one that doesn't exist and fails to compile */
+#define ROW_ID(hex, mode, operation, base, page_penalty, class)                                         \
+    ROW_##hex##_##mode##_##operation##_##base##_##page_penalty##_##class = 1,
+#define FUSED_CHECK(first, first_mode, first_operation, first_base, first_penalty, first_class,         \
+                    second, second_mode, second_operation, second_base, second_penalty, second_class)  \
+    _Static_assert(ROW_##first##_##first_mode##_##first_operation##_##first_base##_##first_penalty##_##first_class && \
+                   ROW_##second##_##second_mode##_##second_operation##_##second_base##_##second_penalty##_##second_class, \
+                   "FUSED_TABLE pair " #first " " #second " differs from OPCODE_TABLE");
+
+enum { OPCODE_TABLE(ROW_ID) };
+FUSED_TABLE(FUSED_CHECK)
+
+/* Registers live in locals of execute_instructions(). cycles holds the master clock at the start of
+   the running instruction, accesses outside the CPU (PPU registers, mapper, scheduler) first publish
+   the cycle they happen on, the instruction's length from the opcode table is added once it is done */
+#define SYNC_AT(cycle) (emu->cycles = cycles + (cycle))
+#define SYNC_CYCLES() (emu->cycles = cycles)
+
+// Mapped pages are a single indexed load, unmapped pages trap to the I/O handlers
+#define READ_AT(address, cycle) (read_pages[(address) >> 8] ?                   \
+    read_pages[(address) >> 8][(address) & 0xFF] : (SYNC_AT(cycle), cpu_read_io(emu, address)))
+#define WRITE_AT(address, data, cycle) {                                        \
+    if (write_pages[(address) >> 8]) write_pages[(address) >> 8][(address) & 0xFF] = (data); \
+    else { SYNC_AT(cycle); cpu_write_io(emu, address, data); }                  \
+}
+
+#define FETCH_BYTE() (counter = PC, PC = (counter == 0xFFFF) ? 0x8000 : counter + 1, READ_AT(counter, 0))
+
+#define FETCH_WORD() {                                                      \
+    counter = PC;                                                           \
+    PC = (counter == 0xFFFF) ? 0x8001 : counter + 2;                        \
+    fetched = (Word) READ_AT(counter, 1);                                   \
+    counter += 1;                                                           \
+    fetched |= ((Word) READ_AT(counter, 2)) << 8;                           \
+}
+
+/* Decode cache. Code in the read-only PRG pages is decoded a basic block at a time into decode_cache, the
+   next time it runs its opcode and operand bytes are a single load. Any other code is fetched byte by
+   byte on the same cycles as before, the operand bytes land in fetched either way */
+#define DECODE() {                                                          \
+    Decoded_op *decoded = &decode_cache[PC & 0x7FFF];                       \
+    if ((PC & 0x8000) && (decoded->size || decode_block(cpu, PC))) {             \
+        op_code = decoded->op_code;                                         \
+        fetched = decoded->operand;                                         \
+        PC += decoded->size;                                                \
+    }                                                                       \
+    else {                                                                  \
+        op_code = FETCH_BYTE();                                             \
+        if (opcode_sizes[op_code] == 2) fetched = FETCH_BYTE();             \
+        else if (opcode_sizes[op_code] == 3) FETCH_WORD();                  \
+    }                                                                       \
+}
+
+#define PUSH(data) {                                    \
+    ram[SP] = (data);                                   \
+    SP = (SP == 0x0100) ? 0x01FF : SP - 1;              \
+}
+#define POP() (SP = (SP == 0x01FF) ? 0x0100 : SP + 1, ram[SP])
+
+/* Lazy flags, N, V and Z are kept as the last result that set them and only folded into a status byte
+   when it is pushed. C stays a 0/1 local since ADC, SBC and the rotates consume it directly */
+#define SET_ZN(value) { n_result = z_result = (value); }
+
+#define STATUS() ((P & (FLAG_I | FLAG_D | FLAG_B)) | C | (n_result & FLAG_N) | \
+    ((v_result & 0x80) ? FLAG_V : 0) | ((z_result) ? 0 : FLAG_Z))
+
+#define STATUS_FROM(PS) {                               \
+    P = (PS) & (FLAG_I | FLAG_D | FLAG_B);              \
+    C = (PS) & FLAG_C;                                  \
+    n_result = (PS);                                    \
+    v_result = (PS) << 1;                               \
+    z_result = ~(PS) & FLAG_Z;                          \
+}
+
+// The I flag may have been cleared with the IRQ line still asserted
+#define POLL_IRQ() { cpu->P = P | C; SYNC_AT(length); poll_irq(emu); }
 
-Byte CLV(void){
-    p_cpu->V = 0;
-    cpu_clock();
-    return 0;
-}
+/*Addressing modes*/
 
-Byte CMP(void){
-    if (p_cpu->current_mode == 1 || p_cpu->current_mode == 2 || p_cpu->current_mode == 3) p_cpu->temp_byte = cpu_read_byte(p_cpu->temp_word);
-    Word a = (Word) p_cpu->A;
-    Word mem = (Word) p_cpu->temp_byte;
-    Word result = a - mem;
-    if (p_cpu->current_mode == 1)
-        cpu_clock();
-    p_cpu->C = (a >= mem) ? 1 : 0;
-    p_cpu->Z = ((result & 0xFF) == 0) ? 1 : 0;
-    p_cpu->N = (result & 0x80) ? 1 : 0;
-    cpu_clock();
-    return 0;
-}
+#define ABS() { address = fetched; }
 
-Byte CPX(void){
-    if (p_cpu->current_mode == 1 || p_cpu->current_mode == 2 || p_cpu->current_mode == 3) p_cpu->temp_byte = cpu_read_byte(p_cpu->temp_word);
-    Word x = (Word) p_cpu->X;
-    Word mem = (Word) p_cpu->temp_byte;
-    Word result = x - mem;
-    if (p_cpu->current_mode == 1)
-        cpu_clock();
-    p_cpu->C = (x >= mem) ? 1 : 0;
-    p_cpu->Z = ((result & 0xFF) == 0) ? 1 : 0;
-    p_cpu->N = (result & 0x80) ? 1 : 0;
-    cpu_clock();
-    return 0;
+#define ABX() {                                         \
+    address = fetched;                                  \
+    Word indexed = address + X;                         \
+    crossed = ((address & 0xFF00) != (indexed & 0xFF00)); \
+    address = indexed;                                  \
 }
 
-Byte CPY(void){
-    if (p_cpu->current_mode == 1 || p_cpu->current_mode == 2 || p_cpu->current_mode == 3) p_cpu->temp_byte = cpu_read_byte(p_cpu->temp_word);
-    Word y = (Word) p_cpu->Y;
-    Word mem = (Word) p_cpu->temp_byte;
-    Word result = y - mem;
-    if (p_cpu->current_mode == 1)
-        cpu_clock();
-    p_cpu->C = (y >= mem) ? 1 : 0;
-    p_cpu->Z = ((result & 0xFF) == 0) ? 1 : 0;
-    p_cpu->N = (result & 0x80) ? 1 : 0;
-    cpu_clock();
-    return 0;
+#define ABY() {                                         \
+    address = fetched;                                  \
+    Word indexed = address + Y;                         \
+    crossed = ((address & 0xFF00) != (indexed & 0xFF00)); \
+    address = indexed;                                  \
 }
 
-Byte DEC(void){
-    if (p_cpu->current_mode == 1 || p_cpu->current_mode == 2 || p_cpu->current_mode == 3) p_cpu->temp_byte = cpu_read_byte(p_cpu->temp_word);
-    p_cpu->temp_byte -= 1; 
-    cpu_clock();
-    cpu_write_byte(p_cpu->temp_word, p_cpu->temp_byte);
-    cpu_clock();
-    if (p_cpu->current_mode == 1 || p_cpu->current_mode == 2)
-        cpu_clock();
-    p_cpu->Z = (p_cpu->temp_byte == 0) ? 1 : 0;
-    p_cpu->N = (p_cpu->temp_byte & 0x80) ? 1 : 0;
-    cpu_clock();
-    return 0;
-}
+#define ACC() { operand = A; }
 
-Byte DEX(void){
-    p_cpu->X -= 1; 
-    p_cpu->Z = (p_cpu->X == 0) ? 1 : 0;
-    p_cpu->N = (p_cpu->X & 0x80) ? 1 : 0;
-    cpu_clock();
-    return 0;
-}
+#define IMP() {}
 
-Byte DEY(void){
-    p_cpu->Y -= 1; 
-    p_cpu->Z = (p_cpu->Y == 0) ? 1 : 0;
-    p_cpu->N = (p_cpu->Y & 0x80) ? 1 : 0;
-    cpu_clock();
-    return 0;
-}
+#define IMM() { operand = (Byte) fetched; }
 
-Byte EOR(void){
-    if (p_cpu->current_mode == 1 || p_cpu->current_mode == 2 || p_cpu->current_mode == 3) p_cpu->temp_byte = cpu_read_byte(p_cpu->temp_word);
-    p_cpu->A ^= p_cpu->temp_byte;
-    if (p_cpu->current_mode == 1)
-        cpu_clock();
-    p_cpu->Z = (p_cpu->A == 0) ? 1 : 0;
-    p_cpu->N = (p_cpu->A & 0x80) ? 1 : 0;
-    cpu_clock();
-    return 0;
+#define IND() {                                                         \
+    address = fetched;                                                  \
+    Byte low = READ_AT(address, 3);                                     \
+    Word high_address = ((address & 0x00FF) == 0x00FF) ? (address & 0xFF00) : address + 1; \
+    Byte high = READ_AT(high_address, 4);                               \
+    address = (((Word) high) << 8) | low;                               \
 }
 
-Byte INC(void){
-    if (p_cpu->current_mode == 1 || p_cpu->current_mode == 2 || p_cpu->current_mode == 3) p_cpu->temp_byte = cpu_read_byte(p_cpu->temp_word);
-    p_cpu->temp_byte += 1; 
-    cpu_clock();
-    cpu_write_byte(p_cpu->temp_word, p_cpu->temp_byte);
-    cpu_clock();
-    if (p_cpu->current_mode == 1 || p_cpu->current_mode == 2)
-        cpu_clock();
-    p_cpu->Z = (p_cpu->temp_byte == 0) ? 1 : 0;
-    p_cpu->N = (p_cpu->temp_byte & 0x80) ? 1 : 0;
-    cpu_clock();
-    return 0;
+#define IZX() {                                                         \
+    Byte zp_address = (Byte) fetched;                                   \
+    zp_address += X;                                                    \
+    address = (((Word) ram[(Word) zp_address + 1]) << 8) | ram[zp_address]; \
 }
 
-Byte INX(void){
-    p_cpu->X += 1; 
-    p_cpu->Z = (p_cpu->X == 0) ? 1 : 0;
-    p_cpu->N = (p_cpu->X & 0x80) ? 1 : 0;
-    cpu_clock();
-    return 0;
+#define IZY() {                                                         \
+    Byte zp_address = (Byte) fetched;                                   \
+    Word base = (((Word) ram[(Word) zp_address + 1]) << 8) | ram[zp_address]; \
+    address = base + Y;                                                 \
+    crossed = ((address & 0xFF00) != (base & 0xFF00));                  \
 }
 
-Byte INY(void){
-    p_cpu->Y += 1; 
-    p_cpu->Z = (p_cpu->Y == 0) ? 1 : 0;
-    p_cpu->N = (p_cpu->Y & 0x80) ? 1 : 0;
-    cpu_clock();
-    return 0;
+#define REL() {                                         \
+    operand = (Byte) fetched;                           \
+    address = PC + (int8_t) operand;                    \
 }
 
-Byte JMP(void){
-    p_cpu->PC = p_cpu->temp_word;
-    cpu_clock();
-    return 0;
-}
+#define ZP0() { address = (Word) (Byte) fetched; }
 
-Byte JSR(void){
-    Word current_pc = p_cpu->PC - 1;
-    cpu_clock();
-    stack_push((Byte) (current_pc >> 8));
-    cpu_clock();
-    stack_push((Byte) current_pc);
-    cpu_clock();
-    p_cpu->PC = p_cpu->temp_word;
-    cpu_clock();
-    return 0;
-}
+#define ZPX() { address = (Word) (Byte) (fetched + X); }
 
-Byte LDA(void){
-    if (p_cpu->current_mode == 1 || p_cpu->current_mode == 2 || p_cpu->current_mode == 3) p_cpu->temp_byte = cpu_read_byte(p_cpu->temp_word);
-    p_cpu->A = p_cpu->temp_byte;
-    if (p_cpu->current_mode == 1)
-        cpu_clock();
-    _set_status_A();
-    cpu_clock();
-    return 0;
-}
+#define ZPY() { address = (Word) (Byte) (fetched + Y); }
 
-Byte LDX(void){
-    if (p_cpu->current_mode == 1 || p_cpu->current_mode == 2 || p_cpu->current_mode == 3) p_cpu->temp_byte = cpu_read_byte(p_cpu->temp_word);
-    p_cpu->X = p_cpu->temp_byte;
-    if (p_cpu->current_mode == 1)
-        cpu_clock();
-    p_cpu->Z = (p_cpu->X == 0) ? 1 : 0;
-    p_cpu->N = (p_cpu->X & 0x80) ? 1 : 0;
-    cpu_clock();
-    return 0;
-}
+/* Idle loops. A backward branch or JMP that comes back to the same target with the same registers and
+   flags, over a body that only reads RAM, PRG or PPUSTATUS, keeps repeating until the next event changes
+   what it reads. The whole iterations left before next_event_cycle are skipped in one step, the PPU is
+   caught up over them by its next sync */
+#define IDLE_LOOP_MAX 16        // Longest loop body checked, in bytes
 
-Byte LDY(void){
-    if (p_cpu->current_mode == 1 || p_cpu->current_mode == 2 || p_cpu->current_mode == 3) p_cpu->temp_byte = cpu_read_byte(p_cpu->temp_word);
-    p_cpu->Y = p_cpu->temp_byte;
-    if (p_cpu->current_mode == 1)
-        cpu_clock();
-    p_cpu->Z = (p_cpu->Y == 0) ? 1 : 0;
-    p_cpu->N = (p_cpu->Y & 0x80) ? 1 : 0;
-    cpu_clock();
-    return 0;
+static bool idle_read(const CPU *cpu, Word address) {
+    // Mapped pages have no read side effects, repeated PPUSTATUS reads only clear what the first one did
+    return cpu->read_pages[address >> 8] || (address >= 0x2000 && address <= 0x3FFF && (address & 7) == 2);
 }
 
-Byte LSR(void){
-    if (p_cpu->current_mode == 4){
-        p_cpu->C = (p_cpu->A & 1) ? 1 : 0;
-        p_cpu->A = p_cpu->A >> 1;
-        p_cpu->Z = (p_cpu->A == 0) ? 1 : 0;
-        p_cpu->N = (p_cpu->A & 0x80) ? 1 : 0;
+// Cycles the code from start up to the closing jump at end takes, -1 unless it is straight line code
+// without stores, stack accesses or other jumps. None of the accepted modes has a page cross penalty
+static int idle_loop_cycles(Emulator *emu, Word start, Word end) {
+    int cycles = 0;
+    if (end - start > IDLE_LOOP_MAX || !emu->cpu.read_pages[start >> 8] || !emu->cpu.read_pages[(Word) (end + 2) >> 8])
+        return -1;
+    while (start < end) {
+        Byte op_code = cpu_read_byte(emu, start);
+        Byte mode = opcode_modes[op_code];
+        if (opcode_classes[op_code] == CLASS_READ) {
+            if (mode == M_ZP0 && !idle_read(&emu->cpu, cpu_read_byte(emu, start + 1))) return -1;
+            if (mode == M_ABS && !idle_read(&emu->cpu, cpu_read_byte(emu, start + 1) | ((Word) cpu_read_byte(emu, start + 2) << 8)))
+                return -1;
+            if (mode != M_IMM && mode != M_ZP0 && mode != M_ABS) return -1;
+        }
+        else if (opcode_classes[op_code] != CLASS_NONE || (mode != M_IMP && mode != M_ACC)) return -1;
+        switch (op_code) {
+            case 0x00: case 0x08: case 0x28: case 0x40: case 0x48: case 0x58: case 0x60: case 0x68: case 0x78:
+                return -1;          // BRK, PHP, PLP, RTI, PHA, CLI, RTS, PLA, SEI
+        }
+        cycles += opcode_cycles[op_code];
+        start += opcode_sizes[op_code];
     }
-    else {
-        if (p_cpu->current_mode == 1 || p_cpu->current_mode == 2 || p_cpu->current_mode == 3) p_cpu->temp_byte = cpu_read_byte(p_cpu->temp_word);
-        p_cpu->C = (p_cpu->temp_byte & 1) ? 1 : 0;
-        cpu_clock();
-        p_cpu->temp_byte >>= 1;
-        cpu_clock();
-        p_cpu->Z = (p_cpu->temp_byte == 0) ? 1 : 0;
-        p_cpu->N = (p_cpu->temp_byte & 0x80) ? 1 : 0;
-        cpu_write_byte(p_cpu->temp_word, p_cpu->temp_byte);
-        if (p_cpu->current_mode == 1 || p_cpu->current_mode == 2)
-            cpu_clock();
-    }
-    cpu_clock();
-    return 0;
-}
-
-Byte NOP(void){
-    cpu_clock();
-    return 0;
-}
-
-Byte ORA(void){
-    if (p_cpu->current_mode == 1 || p_cpu->current_mode == 2 || p_cpu->current_mode == 3) p_cpu->temp_byte = cpu_read_byte(p_cpu->temp_word);
-    p_cpu->A |= p_cpu->temp_byte;
-    if (p_cpu->current_mode == 1)
-        cpu_clock();
-    p_cpu->Z = (p_cpu->A == 0) ? 1 : 0;
-    p_cpu->N = (p_cpu->A & 0x80) ? 1 : 0;
-    cpu_clock();
-    return 0;
-}
-
-Byte PHA(void){
-    stack_push(p_cpu->A);
-    cpu_clock();
-    cpu_clock();
-    return 0;
-}
-
-Byte PHP(void){
-    Byte SR = 0;
-    SR |= (p_cpu->N) ? 0x80 : 0;
-    SR |= (p_cpu->V) ? 0x40 : 0;
-    SR |= 0x20;
-    SR |= (p_cpu->B) ? 0x10 : 0;
-    SR |= (p_cpu->D) ? 0x8 : 0;
-    SR |= 0x4; // Interrupt flag set to 1
-    SR |= (p_cpu->Z) ? 0x2 : 0;
-    SR |= (p_cpu->C) ? 0x1 : 0;
-    cpu_clock();
-    stack_push(SR);
-    cpu_clock();
-    return 0;
-}
-
-Byte PLA(void){
-    cpu_clock();
-    p_cpu->A = stack_pop();
-    cpu_clock();
-    p_cpu->Z = (p_cpu->A == 0) ? 1 : 0;
-    p_cpu->N = (p_cpu->A & 0x80) ? 1 : 0;
-    cpu_clock();
-    return 0;
-}
-
-Byte PLP(void){
-    cpu_clock();
-    Byte PS = stack_pop();
-    cpu_clock();
-    p_cpu->N = (PS & 0x80) ? 1 : 0;
-    p_cpu->V = (PS & 0x40) ? 1 : 0;
-    p_cpu->B = (PS & 0x10) ? 1 : 0;
-    p_cpu->D = (PS & 0x8) ? 1 : 0;
-    p_cpu->I = (PS & 0x4) ? 1 : 0;
-    p_cpu->Z = (PS & 0x2) ? 1 : 0;
-    p_cpu->C = (PS & 1) ? 1 : 0;
-    cpu_clock();
-    return 0;
+    return (start == end) ? cycles : -1;
 }
 
-Byte ROL(void){
-    if (p_cpu->current_mode == 4){
-        p_cpu->C = (p_cpu->A & 0x80) ? 1 : 0;
-        p_cpu->A <<= 1;
-        p_cpu->A |= p_cpu->C;
-        p_cpu->Z = (p_cpu->A == 0) ? 1 : 0;
-        p_cpu->N = (p_cpu->A & 0x80) ? 1 : 0;
+// Handler of the FUSED_TABLE pair first, second, first's own handler when they don't fuse
+static Word fused_handler(Byte first, Byte second) {
+    for (int i = 0; i < FUSED_COUNT; i++) {
+        if (fused_pairs[i][0] == first && fused_pairs[i][1] == second)
+            return 0x100 + i;
     }
-    else {
-        if (p_cpu->current_mode == 1 || p_cpu->current_mode == 2 || p_cpu->current_mode == 3) p_cpu->temp_byte = cpu_read_byte(p_cpu->temp_word);
-        p_cpu->C = (p_cpu->temp_byte & 0x80) ? 1 : 0;
-        cpu_clock();
-        p_cpu->temp_byte <<= 1;
-        cpu_clock();
-        p_cpu->temp_byte |= p_cpu->C;
-        p_cpu->Z = (p_cpu->temp_byte == 0) ? 1 : 0;
-        p_cpu->N = (p_cpu->temp_byte & 0x80) ? 1 : 0;
-        cpu_write_byte(p_cpu->temp_word, p_cpu->temp_byte);
-        if (p_cpu->current_mode == 1 || p_cpu->current_mode == 2)
-            cpu_clock();
+    return first;
+}
+
+// Decodes from address up to the first jump, branch or return, staying inside address's page.
+// Returns false when the instruction at address can't be cached and has to be fetched normally
+static bool decode_block(CPU *cpu, Word address) {
+    Byte *page = cpu->read_pages[address >> 8];
+    if (!page || cpu->write_pages[address >> 8])
+        return false;                               // RAM, or I/O with read side effects
+    Word start = address;
+    Decoded_op *previous = NULL;
+    for (;;) {
+        Byte op_code = page[address & 0xFF], size = opcode_sizes[op_code];
+        // Illegal opcodes and instructions running into the next page or past $FFFF stay uncached
+        if (!size || (address & 0xFF) + size > 0x100 || address + size > 0xFFFF)
+            break;
+        Decoded_op *decoded = &cpu->decode_cache[address & 0x7FFF];
+        *decoded = (Decoded_op) {
+            .op_code = op_code,
+            .size = size,
+            .operand = (size > 1 ? page[(address + 1) & 0xFF] : 0) | (size > 2 ? (Word) page[(address + 2) & 0xFF] << 8 : 0),
+            .handler = op_code,
+        };
+        // Both halves of a pair are in the same page, so they are always dropped together
+        if (previous) previous->handler = fused_handler(previous->op_code, op_code);
+        previous = decoded;
+        address += size;
+        if (opcode_modes[op_code] == M_REL || (address & 0xFF) == 0)
+            break;
+        switch (op_code) {
+            case 0x00: case 0x20: case 0x40: case 0x4C: case 0x60: case 0x6C:
+                return true;                        // BRK, JSR, RTI, JMP, RTS, JMP (ind)
+        }
     }
-    cpu_clock();
-    return 0;
-}
-
-Byte ROR(void){
-    if (p_cpu->current_mode == 4){
-        p_cpu->C = (p_cpu->A & 1) ? 1 : 0;
-        p_cpu->A >>= 1;
-        p_cpu->A |= (p_cpu->C) ? 0x80 : 0;
-        p_cpu->Z = (p_cpu->A == 0) ? 1 : 0;
-        p_cpu->N = (p_cpu->A & 0x80) ? 1 : 0;
+    return address != start;
+}
+
+// Everything an iteration can change, besides the cycle count
+#define IDLE_STATE() ((uint64_t) A | ((uint64_t) X << 8) | ((uint64_t) Y << 16) | ((uint64_t) (P | C) << 24) |   \
+    ((uint64_t) n_result << 32) | ((uint64_t) v_result << 40) | ((uint64_t) z_result << 48) | ((uint64_t) (Byte) SP << 56))
+
+/* Called by the jump at `at` before it goes to target, cycles + length is when the target starts. The
+   last pass only ran the body if exactly its cycles went by, anything else left through the jump */
+#define IDLE_LOOP(target, at) {                                                         \
+    int64_t key = ((int64_t) (target) << 16) | (at);                                    \
+    uint64_t state = IDLE_STATE();                                                      \
+    if (key != idle_key) {                                                              \
+        idle_key = key;                                                                 \
+        idle_body = idle_loop_cycles(emu, (target), (at));                              \
+    }                                                                                   \
+    else if (idle_body >= 0 && cycles - idle_cycles == idle_body && state == idle_state) { \
+        int64_t period = idle_body + length;                                            \
+        if (scheduler->next_event_cycle - (cycles + length) > period)                   \
+            cycles += (scheduler->next_event_cycle - (cycles + length) - 1) / period * period; \
+    }                                                                                   \
+    idle_state = state;                                                                 \
+    idle_cycles = cycles + length;                                                      \
+}
+
+/*Operations*/
+
+#define ADC(mode) {                                                     \
+    Word acc = (Word) A;                                                \
+    Word value = (Word) operand;                                        \
+    Word sum = acc + value + C;                                         \
+    A = (Byte) sum;                                                     \
+    C = (sum > 256) ? 1 : 0;                                            \
+    z_result = (Byte) sum | (Byte) (sum >> 8);                          \
+    v_result = ~(acc ^ value) & (acc ^ sum);                            \
+    n_result = (Byte) sum;                                              \
+}
+
+#define SBC(mode) {                                                     \
+    Word acc = (Word) A;                                                \
+    Word value = ((Word) operand) ^ 0x00FF;                             \
+    Word sum = acc + value + C;                                         \
+    A = (Byte) sum;                                                     \
+    C = (sum > 256) ? 1 : 0;                                            \
+    z_result = (Byte) sum | (Byte) (sum >> 8);                          \
+    v_result = ~(acc ^ value) & (acc ^ sum);                            \
+    n_result = (Byte) sum;                                              \
+}
+
+#define AND(mode) { A &= operand; SET_ZN(A); }
+#define EOR(mode) { A ^= operand; SET_ZN(A); }
+#define ORA(mode) { A |= operand; SET_ZN(A); }
+
+#define ASL(mode) {                                                     \
+    if ((mode) == M_ACC) {                                              \
+        C = (A & 0x80) ? 1 : 0;                                         \
+        A <<= 1;                                                        \
+        SET_ZN(A);                                                      \
+    }                                                                   \
+    else {                                                              \
+        C = (operand & 0x80) ? 1 : 0;                                   \
+        operand >>= 1;                                                  \
+        SET_ZN(operand);                                                \
+        WRITE_AT(address, operand, length - 1);                         \
+    }                                                                   \
+}
+
+#define LSR(mode) {                                                     \
+    if ((mode) == M_ACC) {                                              \
+        C = (A & 1) ? 1 : 0;                                            \
+        A = A >> 1;                                                     \
+        SET_ZN(A);                                                      \
+    }                                                                   \
+    else {                                                              \
+        C = (operand & 1) ? 1 : 0;                                      \
+        operand >>= 1;                                                  \
+        SET_ZN(operand);                                                \
+        WRITE_AT(address, operand, length - 1);                         \
+    }                                                                   \
+}
+
+#define ROL(mode) {                                                     \
+    if ((mode) == M_ACC) {                                              \
+        C = (A & 0x80) ? 1 : 0;                                         \
+        A <<= 1;                                                        \
+        A |= C;                                                         \
+        SET_ZN(A);                                                      \
+    }                                                                   \
+    else {                                                              \
+        C = (operand & 0x80) ? 1 : 0;                                   \
+        operand <<= 1;                                                  \
+        operand |= C;                                                   \
+        SET_ZN(operand);                                                \
+        WRITE_AT(address, operand, length - 1);                         \
+    }                                                                   \
+}
+
+#define ROR(mode) {                                                     \
+    if ((mode) == M_ACC) {                                              \
+        C = (A & 1) ? 1 : 0;                                            \
+        A >>= 1;                                                        \
+        A |= (C) ? 0x80 : 0;                                            \
+        SET_ZN(A);                                                      \
+    }                                                                   \
+    else {                                                              \
+        C = (operand & 1) ? 1 : 0;                                      \
+        operand >>= 1;                                                  \
+        operand |= (C) ? 0x80 : 0;                                      \
+        SET_ZN(operand);                                                \
+        WRITE_AT(address, operand, length - 1);                         \
+    }                                                                   \
+}
+
+// A taken branch costs one more cycle, two when the target is on another page
+#define BRANCH(condition) {                                             \
+    if (condition) {                                                    \
+        length += ((PC & 0xFF00) != (address & 0xFF00)) ? 2 : 1;        \
+        if (address < PC) IDLE_LOOP(address, PC - 2);                   \
+        PC = address;                                                   \
+    }                                                                   \
+}
+
+#define BCC(mode) BRANCH(!C)
+#define BCS(mode) BRANCH(C)
+#define BEQ(mode) BRANCH(!z_result)
+#define BMI(mode) BRANCH(n_result & 0x80)
+#define BNE(mode) BRANCH(z_result)
+#define BPL(mode) BRANCH(!(n_result & 0x80))
+#define BVC(mode) BRANCH(!(v_result & 0x80))
+#define BVS(mode) BRANCH(v_result & 0x80)
+
+#define BIT(mode) {                                                     \
+    n_result = operand;                                                 \
+    v_result = operand << 1;                                            \
+    z_result = operand & A;                                             \
+}
+
+#define BRK(mode) {                                                     \
+    PC += 1;                                                            \
+    PUSH((Byte) (PC >> 8));                                             \
+    PUSH((Byte) PC);                                                    \
+    PUSH(STATUS() | FLAG_B);                                            \
+    P |= FLAG_I;                                                        \
+    Word vector = READ_AT(0xFFFE, 5);                                   \
+    vector |= ((Word) READ_AT(0xFFFF, 6)) << 8;                         \
+    PC = vector;                                                        \
+}
+
+#define CLC(mode) { C = 0; }
+#define CLD(mode) { P &= ~FLAG_D; }
+#define CLI(mode) { P &= ~FLAG_I; POLL_IRQ(); }
+#define CLV(mode) { v_result = 0; }
+#define SEC(mode) { C = 1; }
+#define SED(mode) { P |= FLAG_D; }
+#define SEI(mode) { P |= FLAG_I; }
+
+#define COMPARE(reg) {                                                  \
+    Word result = (Word) (reg) - (Word) operand;                        \
+    C = ((reg) >= operand) ? 1 : 0;                                     \
+    SET_ZN((Byte) result);                                              \
+}
+
+#define CMP(mode) COMPARE(A)
+#define CPX(mode) COMPARE(X)
+#define CPY(mode) COMPARE(Y)
+
+#define STEP_MEMORY(delta) {                                            \
+    operand += (delta);                                                 \
+    WRITE_AT(address, operand, length - 1);                             \
+    SET_ZN(operand);                                                    \
+}
+
+#define DEC(mode) STEP_MEMORY(-1)
+#define INC(mode) STEP_MEMORY(1)
+
+#define DEX(mode) { X -= 1; SET_ZN(X); }
+#define DEY(mode) { Y -= 1; SET_ZN(Y); }
+#define INX(mode) { X += 1; SET_ZN(X); }
+#define INY(mode) { Y += 1; SET_ZN(Y); }
+
+#define JMP(mode) {                                                     \
+    if ((mode) == M_ABS && address < PC) IDLE_LOOP(address, PC - 3);    \
+    PC = address;                                                       \
+}
+
+#define JSR(mode) {                                                     \
+    Word return_address = PC - 1;                                       \
+    PUSH((Byte) (return_address >> 8));                                 \
+    PUSH((Byte) return_address);                                        \
+    PC = address;                                                       \
+}
+
+#define LDA(mode) { A = operand; SET_ZN(A); }
+#define LDX(mode) { X = operand; SET_ZN(X); }
+#define LDY(mode) { Y = operand; SET_ZN(Y); }
+
+#define NOP(mode) {}
+
+#define PHA(mode) { PUSH(A); }
+
+#define PHP(mode) { PUSH(STATUS() | FLAG_U | FLAG_I); }
+
+#define PLA(mode) { A = POP(); SET_ZN(A); }
+
+#define PLP(mode) {                                                     \
+    Byte PS = POP();                                                    \
+    STATUS_FROM(PS);                                                    \
+    POLL_IRQ();                                                         \
+}
+
+#define RTI(mode) {                                                     \
+    Byte PS = POP();                                                    \
+    STATUS_FROM(PS);                                                    \
+    POLL_IRQ();                                                         \
+    Word return_address = (Word) POP();                                 \
+    return_address |= ((Word) POP()) << 8;                              \
+    PC = return_address;                                                \
+}
+
+#define RTS(mode) {                                                     \
+    Word return_address = (Word) POP();                                 \
+    return_address |= ((Word) POP()) << 8;                              \
+    PC = return_address + 1;                                            \
+}
+
+#define STA(mode) WRITE_AT(address, A, length - 1)
+#define STX(mode) WRITE_AT(address, X, length - 1)
+#define STY(mode) WRITE_AT(address, Y, length - 1)
+
+#define TAX(mode) { X = A; SET_ZN(X); }
+#define TAY(mode) { Y = A; SET_ZN(Y); }
+#define TSX(mode) { X = (Byte) SP; SET_ZN(X); }
+#define TXA(mode) { A = X; SET_ZN(X); }
+#define TXS(mode) { SP = (Word) X | 0x100; }
+#define TYA(mode) { A = Y; SET_ZN(Y); }
+
+/* Dispatch, threaded through computed goto on GCC/Clang and a dense switch elsewhere */
+#ifndef USE_COMPUTED_GOTO
+#if defined(__GNUC__)
+#define USE_COMPUTED_GOTO 1
+#else
+#define USE_COMPUTED_GOTO 0
+#endif
+#endif
+
+#if USE_COMPUTED_GOTO
+#define OPCODE(hex) op_##hex
+#define ILLEGAL_OPCODE op_NUL
+#define DISPATCH() goto *dispatch_table[op_code];
+/* Handlers only dispatch decoded instructions themselves, anything else goes back through next_instruction.
+   A decoded instruction enters its handler one step early to add its constant size to PC, which keeps
+   the decode cache load off the chain of PC updates */
+#define NEXT() {                                                        \
+    if (cycles >= scheduler->next_event_cycle) goto exit_loop;          \
+    Decoded_op *decoded = &decode_cache[PC & 0x7FFF];                   \
+    if (!(PC & 0x8000) || !decoded->size) goto next_instruction;        \
+    fetched = decoded->operand;                                         \
+    goto *decoded_table[decoded->handler];                              \
+}
+#define DECODED(hex, mode) decoded_##hex: PC += SIZE_##mode;
+#define DISPATCH_ENTRY(hex, mode, operation, base, page_penalty, class) [0x##hex] = &&op_##hex,
+#define DECODED_ENTRY(hex, mode, operation, base, page_penalty, class) [0x##hex] = &&decoded_##hex,
+#define FUSED_ENTRY(first, first_mode, first_operation, first_base, first_penalty, first_class,         \
+                    second, second_mode, second_operation, second_base, second_penalty, second_class)  \
+    [0x100 + FUSED_##first##_##second] = &&fused_##first##_##second,
+#else
+#define OPCODE(hex) case 0x##hex
+#define ILLEGAL_OPCODE default
+#define DISPATCH() switch (op_code)
+#define NEXT() goto next_instruction
+#define DECODED(hex, mode)
+#endif
+
+/* One specialized handler per opcode table entry. The operand of READ and RMW instructions is read
+   here so the operations only see operand, the page cross penalty only applies to READ instructions */
+#define EXECUTE(hex, mode, operation, base, page_penalty, class) {      \
+    mode();                                                             \
+    length = (base) + ((page_penalty) ? crossed : 0);                   \
+    if (CLASS_##class == CLASS_READ && M_##mode != M_IMM)               \
+        operand = READ_AT(address, length - 1);                         \
+    if (CLASS_##class == CLASS_RMW)                                     \
+        operand = READ_AT(address, length - 3);                         \
+    operation(M_##mode);                                                \
+    cycles += length;                                                   \
+    PROFILE_ADD(instructions, 1);                                       \
+}
+
+#define INSTRUCTION(hex, mode, operation, base, page_penalty, class)       \
+    DECODED(hex, mode)                                                  \
+    OPCODE(hex): EXECUTE(hex, mode, operation, base, page_penalty, class) \
+    NEXT();
+
+/* A fused pair takes the second instruction straight from the decode cache behind the first one. The
+   event check between the two stays, so interrupts still land on the same instruction boundary */
+#define FUSED(first, first_mode, first_operation, first_base, first_penalty, first_class,               \
+              second, second_mode, second_operation, second_base, second_penalty, second_class)        \
+    fused_##first##_##second:                                                                           \
+        PC += SIZE_##first_mode;                                                                        \
+        EXECUTE(first, first_mode, first_operation, first_base, first_penalty, first_class)             \
+        if (cycles >= scheduler->next_event_cycle) goto exit_loop;                                      \
+        if (!decode_cache[PC & 0x7FFF].size) goto next_instruction;    /* First one switched banks */   \
+        fetched = decode_cache[PC & 0x7FFF].operand;                                                    \
+        PC += SIZE_##second_mode;                                                                       \
+        fused += 1;                                                                                     \
+        EXECUTE(second, second_mode, second_operation, second_base, second_penalty, second_class)       \
+        NEXT();
+
+void execute_instructions(Emulator *emu) {
+    CPU *cpu = &emu->cpu;
+    const Scheduler *scheduler = &emu->scheduler;
+    Word PC = cpu->PC, SP = cpu->SP;
+    Byte A = cpu->A, X = cpu->X, Y = cpu->Y;
+    Byte P = cpu->P & ~FLAG_C, C = cpu->P & FLAG_C;
+    Byte n_result = cpu->n_result, v_result = cpu->v_result, z_result = cpu->z_result;
+    Byte *ram = cpu->Bus.RAM;
+    Byte **read_pages = cpu->read_pages, **write_pages = cpu->write_pages;
+    Decoded_op *decode_cache = cpu->decode_cache;
+    int64_t cycles = emu->cycles;
+
+    Byte op_code, operand = 0, length, crossed = 0;
+    Word counter, address = 0, fetched = 0;
+
+    int64_t idle_key = -1, idle_cycles = 0;
+    uint64_t idle_state = 0;
+    int idle_body = -1;
+
+#if USE_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Woverride-init"
+    static const void *dispatch_table[256] = {
+        [0x00 ... 0xFF] = &&op_NUL,
+        OPCODE_TABLE(DISPATCH_ENTRY)
+    };
+#pragma GCC diagnostic pop
+    static const void *decoded_table[0x100 + FUSED_COUNT] = { OPCODE_TABLE(DECODED_ENTRY) FUSED_TABLE(FUSED_ENTRY) };
+    uint64_t fused = 0;
+#endif
+#ifdef PROFILE_SUBSYSTEMS
+    uint64_t instructions = 0;
+#endif
+
+next_instruction:
+    if (cycles >= scheduler->next_event_cycle) goto exit_loop;
+    DECODE();
+    DISPATCH() {
+        OPCODE_TABLE(INSTRUCTION)
+        ILLEGAL_OPCODE:
+            cycles += 1;
+            NEXT();
+#if USE_COMPUTED_GOTO
+        FUSED_TABLE(FUSED)
+#endif
     }
-    else {
-        if (p_cpu->current_mode == 1 || p_cpu->current_mode == 2 || p_cpu->current_mode == 3) p_cpu->temp_byte = cpu_read_byte(p_cpu->temp_word);
-        p_cpu->C = (p_cpu->temp_byte & 1) ? 1 : 0;
-        cpu_clock();
-        p_cpu->temp_byte >>= 1;
-        cpu_clock();
-        p_cpu->temp_byte |= (p_cpu->C) ? 0x80 : 0;
-        p_cpu->Z = (p_cpu->temp_byte == 0) ? 1 : 0;
-        p_cpu->N = (p_cpu->temp_byte & 0x80) ? 1 : 0;
-        cpu_write_byte(p_cpu->temp_word, p_cpu->temp_byte);
-        if (p_cpu->current_mode == 1 || p_cpu->current_mode == 2)
-            cpu_clock();
-    }
-    cpu_clock();
-    return 0;
-}
-
-Byte RTI(void){
-    Byte PS = stack_pop();
-    cpu_clock();
-    p_cpu->N = (PS & 0x80) ? 1 : 0;
-    p_cpu->V = (PS & 0x40) ? 1 : 0;
-    p_cpu->B = (PS & 0x10) ? 1 : 0;
-    p_cpu->D = (PS & 0x8) ? 1 : 0;
-    p_cpu->I = (PS & 0x4) ? 1 : 0;
-    p_cpu->Z = (PS & 0x2) ? 1 : 0;
-    p_cpu->C = (PS & 1) ? 1 : 0;
-    cpu_clock();
-    Word new_PC = (Word) stack_pop();
-    cpu_clock();
-    new_PC |= ((Word) stack_pop()) << 8;
-    cpu_clock();
-    p_cpu->PC = new_PC;
-    cpu_clock();
-    return 0;
-}
-
-Byte RTS(void){
-    cpu_clock();
-    Word new_PC = (Word) stack_pop();
-    cpu_clock();
-    new_PC |= ((Word) stack_pop()) << 8;
-    cpu_clock();
-    cpu_clock();
-    p_cpu->PC = new_PC + 1;
-    cpu_clock();
-    return 0;
-}
 
-Byte SBC(void){
-    if (p_cpu->current_mode == 1 || p_cpu->current_mode == 2 || p_cpu->current_mode == 3) p_cpu->temp_byte = cpu_read_byte(p_cpu->temp_word);
-    Word acc = (Word) p_cpu->A;
-    Word tmp_byte = ((Word) p_cpu->temp_byte) ^ 0x00FF;
-    Word temp_sum = acc + tmp_byte + p_cpu->C;
-
-    p_cpu->A = (Byte) temp_sum;
-    if (p_cpu->current_mode == 1)
-        cpu_clock();
-    p_cpu->C = (temp_sum > 256) ? 1 : 0;
-    p_cpu->Z = (temp_sum == 0) ? 1 : 0;
-    p_cpu->V = (~(acc ^ tmp_byte) & (acc ^ temp_sum) & 0x80) ? 1 : 0;
-    p_cpu->N = (temp_sum & 0x80) ? 1 : 0;
-    cpu_clock();
-    return 0;
-}
-
-Byte SEC(void){
-    p_cpu->C = 1;
-    cpu_clock();
-    return 0;
-}
-
-Byte SED(void){
-    p_cpu->D = 1;
-    cpu_clock();
-    return 0;
+exit_loop:
+    SYNC_CYCLES();
+    cpu->PC = PC; cpu->SP = SP;
+    cpu->A = A; cpu->X = X; cpu->Y = Y;
+    cpu->P = P | C;
+    cpu->n_result = n_result; cpu->v_result = v_result; cpu->z_result = z_result;
+#if USE_COMPUTED_GOTO
+    emu->fused_dispatches += fused;
+#endif
+    PROFILE_ADD(emu->profile.instructions, instructions);
 }
-
-Byte SEI(void){
-    p_cpu->I = 1;
-    cpu_clock();
-    return 0;
-}
-
-Byte STA(void){
-    if (p_cpu->current_mode == 1 || p_cpu->current_mode == 2 || p_cpu->current_mode == 3)
-        cpu_clock();
-    cpu_write_byte(p_cpu->temp_word, p_cpu->A);
-    cpu_clock();
-    return 0;
-}
-
-Byte STX(void){
-    cpu_write_byte(p_cpu->temp_word, p_cpu->X);
-    if (p_cpu->current_mode == 1)
-        cpu_clock();
-    cpu_clock();
-    return 0;
-}
-
-Byte STY(void){
-    cpu_write_byte(p_cpu->temp_word, p_cpu->Y);
-    if (p_cpu->current_mode == 1)
-        cpu_clock();
-    cpu_clock();
-    return 0;
-}
-
-Byte TAX(void){
-    p_cpu->X = p_cpu->A;
-    p_cpu->Z = (p_cpu->X == 0) ? 1 : 0;
-    p_cpu->N = (p_cpu->X & 0x80) ? 1 : 0;
-    cpu_clock();
-    return 0;
-}
-
-Byte TAY(void){
-    p_cpu->Y = p_cpu->A;
-    p_cpu->Z = (p_cpu->Y == 0) ? 1 : 0;
-    p_cpu->N = (p_cpu->Y & 0x80) ? 1 : 0;
-    cpu_clock();
-    return 0;
-}
-
-Byte TSX(void){
-    p_cpu->X = (Byte) p_cpu->SP;
-    p_cpu->Z = (p_cpu->X == 0) ? 1 : 0;
-    p_cpu->N = (p_cpu->X & 0x80) ? 1 : 0;
-    cpu_clock();
-    return 0;
-}
-
-Byte TXA(void){
-    p_cpu->A = p_cpu->X;
-    p_cpu->Z = (p_cpu->X == 0) ? 1 : 0;
-    p_cpu->N = (p_cpu->X & 0x80) ? 1 : 0;
-    cpu_clock();
-    return 0;
-}
-
-Byte TXS(void){
-    p_cpu->SP = (Word) p_cpu->X;
-    p_cpu->SP |= 0x100;
-    cpu_clock();
-    return 0;
-}
-
-Byte TYA(void){
-    p_cpu->A = p_cpu->Y;
-    p_cpu->Z = (p_cpu->Y == 0) ? 1 : 0;
-    p_cpu->N = (p_cpu->Y & 0x80) ? 1 : 0;
-    cpu_clock();
-    return 0;
-}
-
-Byte NUL(void){
-    return 0;
-}
-
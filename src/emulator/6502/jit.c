@@ -0,0 +1,727 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../emulator.h"
+#include "../../utils.h"
+#include "instructions.h"
+#include "opcodes.h"
+#include "jit.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#define JIT_CODE_SIZE (1 << 20)         // Executable buffer, flushed whole when it runs out
+#define JIT_BLOCK_CODE_MAX 8192         // Host code a single block can take at most
+#define JIT_MAX_BLOCKS 8192
+#define JIT_BLOCK_LENGTH 64             // Most instructions in one block
+#define JIT_HOT_COUNT 8                 // Visits of a block start before it is compiled
+
+/* Compiled blocks take the CPU and return the cycles they ran. Registers are held in host registers
+   inside a block and written back with PC on its way out, the lazy flag results stay in memory */
+typedef int (*Block_code)(CPU *cpu);
+
+typedef struct {
+    Block_code code;                    // NULL when the first instruction can't be compiled
+    int max_cycles;                     // Upper bound with every page cross and a taken branch
+    bool idle;                          // Branches back to its own start without writing anything
+} Jit_block;
+
+// Compiled code of one emulator instance, compiled blocks point into its CPU
+struct Jit {
+    Byte *code_buffer;
+    size_t code_used;
+    Jit_block block_pool[JIT_MAX_BLOCKS];
+    int blocks_used;
+    Jit_block *blocks[0x8000];          // By block start - $8000
+    Byte heat[0x8000];
+};
+
+static void clear_blocks(Jit *jit);
+static Jit_block *compile_block(Jit *jit, const CPU *cpu, Word start);
+static void run_idle_block(Emulator *emu, Jit_block *block);
+static void step_instruction(Emulator *emu);
+
+bool init_jit(Emulator *emu) {
+    if (emu->jit) return true;
+    Jit *jit = malloc(sizeof(Jit));
+    if (!jit) {
+        ERROR("Unable to allocate %d bytes for the JIT block cache", (int) sizeof(Jit));
+        return false;
+    }
+#ifdef _WIN32
+    jit->code_buffer = VirtualAlloc(NULL, JIT_CODE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+    jit->code_buffer = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit->code_buffer == MAP_FAILED) jit->code_buffer = NULL;
+#endif
+    if (!jit->code_buffer) {
+        ERROR("Unable to allocate %d bytes of executable memory for the JIT", JIT_CODE_SIZE);
+        free(jit);
+        return false;
+    }
+    emu->jit = jit;
+    jit_flush(emu);
+    return true;
+}
+
+void execute_jit(Emulator *emu) {
+    Jit *jit = emu->jit;
+    CPU *cpu = &emu->cpu;
+    while (emu->cycles < emu->scheduler.next_event_cycle) {
+        Word PC = cpu->PC;
+        Jit_block *block = NULL;
+        if (PC & 0x8000) {
+            block = jit->blocks[PC & 0x7FFF];
+            if (!block && ++jit->heat[PC & 0x7FFF] >= JIT_HOT_COUNT)
+                block = compile_block(jit, cpu, PC);
+        }
+        // A block has no I/O, so it runs whole as long as no event can fall inside it
+        if (block && block->code && emu->cycles + block->max_cycles < emu->scheduler.next_event_cycle) {
+            if (block->idle) run_idle_block(emu, block);
+            else emu->cycles += block->code(cpu);
+        }
+        else
+            step_instruction(emu);
+    }
+}
+
+void jit_flush(Emulator *emu) {
+    if (emu->jit) clear_blocks(emu->jit);
+}
+
+static void clear_blocks(Jit *jit) {
+    jit->code_used = 0;
+    jit->blocks_used = 0;
+    memset(jit->blocks, 0, sizeof(jit->blocks));
+    memset(jit->heat, 0, sizeof(jit->heat));
+}
+
+void exit_jit(Emulator *emu) {
+    Jit *jit = emu->jit;
+    if (!jit) return;
+#ifdef _WIN32
+    VirtualFree(jit->code_buffer, 0, MEM_RELEASE);
+#else
+    munmap(jit->code_buffer, JIT_CODE_SIZE);
+#endif
+    free(jit);
+    emu->jit = NULL;
+}
+
+static void run_idle_block(Emulator *emu, Jit_block *block) {
+    /* A loop that writes nothing and comes back with the same registers and flags will spin the same way
+       until an event changes something, skip whole iterations like the interpreter's IDLE_LOOP */
+    CPU *cpu = &emu->cpu;
+    Word start = cpu->PC, SP = cpu->SP;
+    Byte registers[7] = {cpu->A, cpu->X, cpu->Y, cpu->P, cpu->n_result, cpu->v_result, cpu->z_result};
+    int period = block->code(cpu);
+    emu->cycles += period;
+    Byte after[7] = {cpu->A, cpu->X, cpu->Y, cpu->P, cpu->n_result, cpu->v_result, cpu->z_result};
+    if (cpu->PC != start || cpu->SP != SP || memcmp(registers, after, sizeof(after)) != 0)
+        return;
+    int64_t skip = (emu->scheduler.next_event_cycle - emu->cycles - 1) / period * period;
+    if (skip > 0) emu->cycles += skip;
+}
+
+static void step_instruction(Emulator *emu) {
+    // Same single step as execute_cpu_ppu(), on an event type of its own so run_cycles() budgets survive
+    schedule_event(emu, EVENT_CPU_STEP, emu->cycles + 1, NULL);
+    execute_instructions(emu);
+    cancel_event(emu, EVENT_CPU_STEP);
+}
+
+/*Opcode table*/
+
+enum Mode { MODE_ABS, MODE_ABX, MODE_ABY, MODE_ACC, MODE_IMP, MODE_IMM, MODE_IND, MODE_IZX, MODE_IZY,
+            MODE_REL, MODE_ZP0, MODE_ZPX, MODE_ZPY };
+
+enum Operation {
+    OP_ADC, OP_AND, OP_ASL, OP_BCC, OP_BCS, OP_BEQ, OP_BIT, OP_BMI, OP_BNE, OP_BPL, OP_BRK, OP_BVC,
+    OP_BVS, OP_CLC, OP_CLD, OP_CLI, OP_CLV, OP_CMP, OP_CPX, OP_CPY, OP_DEC, OP_DEX, OP_DEY, OP_EOR,
+    OP_INC, OP_INX, OP_INY, OP_JMP, OP_JSR, OP_LDA, OP_LDX, OP_LDY, OP_LSR, OP_NOP, OP_ORA, OP_PHA,
+    OP_PHP, OP_PLA, OP_PLP, OP_ROL, OP_ROR, OP_RTI, OP_RTS, OP_SBC, OP_SEC, OP_SED, OP_SEI, OP_STA,
+    OP_STX, OP_STY, OP_TAX, OP_TAY, OP_TSX, OP_TXA, OP_TXS, OP_TYA
+};
+
+typedef struct {
+    Byte legal, mode, operation, cycles, page_penalty, class;
+} Opcode_info;
+
+#define INFO_ENTRY(hex, mode, operation, base, page_penalty, class) \
+    [0x##hex] = {1, MODE_##mode, OP_##operation, (base), (page_penalty), CLASS_##class},
+
+static const Opcode_info opcode_info[256] = { OPCODE_TABLE(INFO_ENTRY) };
+
+static const Byte mode_sizes[] = {
+    [MODE_ABS] = 3, [MODE_ABX] = 3, [MODE_ABY] = 3, [MODE_ACC] = 1, [MODE_IMP] = 1, [MODE_IMM] = 2, [MODE_IND] = 3,
+    [MODE_IZX] = 2, [MODE_IZY] = 2, [MODE_REL] = 2, [MODE_ZP0] = 2, [MODE_ZPX] = 2, [MODE_ZPY] = 2
+};
+
+/*x86-64 emitter*/
+
+enum Reg { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11 };
+
+// Only registers that are volatile in both the System V and the Windows ABI, plus the pushed RBX, RSI, RDI
+#define REG_A R8
+#define REG_X R9
+#define REG_Y R10
+#define REG_CPU R11
+#define REG_C RSI                       // Carry as 0 / 1
+#define REG_CYCLES RBX                  // Page cross penalties and exit cycles
+
+#ifdef _WIN32
+#define REG_ARG RCX
+#else
+#define REG_ARG RDI
+#endif
+
+enum Condition { CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7 };
+
+// ALU opcodes of the "op r/m32, r32" forms and the /digit of their immediate forms
+#define ALU_ADD 0x01
+#define ALU_OR 0x09
+#define ALU_AND 0x21
+#define ALU_SUB 0x29
+#define ALU_XOR 0x31
+#define ALU_CMP 0x39
+#define ALU_MOV 0x89
+#define EXT(alu) ((alu) >> 3)
+
+#define NO_INDEX -1
+
+typedef struct {
+    int base, index;
+    int32_t disp;
+} Mem;
+
+static _Thread_local Byte *out;         // Write position while compiling, instances can compile on their own threads
+
+#define FIELD(member) ((Mem) {REG_CPU, NO_INDEX, (int32_t) offsetof(CPU, member)})
+#define RAM(index, disp) ((Mem) {REG_CPU, (index), (int32_t) (offsetof(CPU, Bus.RAM) + (disp))})
+
+static void emit(Byte data) {
+    *out++ = data;
+}
+
+static void emit32(uint32_t data) {
+    memcpy(out, &data, 4);
+    out += 4;
+}
+
+static void emit_rex(bool wide, bool byte_reg, int reg, int index, int base) {
+    // Byte registers always get a REX prefix so SIL and DIL are reachable
+    Byte rex = 0x40 | (wide ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((index & 8) ? 2 : 0) | ((base & 8) ? 1 : 0);
+    if (rex != 0x40 || byte_reg) emit(rex);
+}
+
+static void emit_opcode(int opcode) {
+    if (opcode > 0xFF) emit((Byte) (opcode >> 8));
+    emit((Byte) opcode);
+}
+
+// opcode reg, [base + index + disp32]
+static void emit_mem(int opcode, int reg, Mem mem, bool byte_reg) {
+    emit_rex(false, byte_reg, reg, (mem.index == NO_INDEX) ? 0 : mem.index, mem.base);
+    emit_opcode(opcode);
+    if (mem.index == NO_INDEX) {
+        emit(0x80 | ((reg & 7) << 3) | (mem.base & 7));
+    }
+    else {
+        emit(0x84 | ((reg & 7) << 3));
+        emit(((mem.index & 7) << 3) | (mem.base & 7));
+    }
+    emit32((uint32_t) mem.disp);
+}
+
+// opcode with a register ModRM, reg is the register or the /digit
+static void emit_reg(int opcode, int reg, int rm, bool byte_reg) {
+    emit_rex(false, byte_reg, reg, 0, rm);
+    emit_opcode(opcode);
+    emit(0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+static void load_byte(int reg, Mem mem) { emit_mem(0x0FB6, reg, mem, false); }
+static void load_word(int reg, Mem mem) { emit_mem(0x0FB7, reg, mem, false); }
+static void store_byte(Mem mem, int reg) { emit_mem(0x88, reg, mem, true); }
+static void store_word(Mem mem, int reg) { emit(0x66); emit_mem(0x89, reg, mem, false); }
+
+static void store_imm(Mem mem, Byte value) {
+    emit_mem(0xC6, 0, mem, false);
+    emit(value);
+}
+
+static void alu_mem_imm(int alu, Mem mem, Byte value) {
+    emit_mem(0x80, EXT(alu), mem, false);
+    emit(value);
+}
+
+static void test_mem_imm(Mem mem, Byte value) {
+    emit_mem(0xF6, 0, mem, false);
+    emit(value);
+}
+
+static void alu(int alu, int dst, int src) { emit_reg(alu, src, dst, false); }
+
+static void alu_imm(int alu, int dst, int32_t value) {
+    emit_reg(0x81, EXT(alu), dst, false);
+    emit32((uint32_t) value);
+}
+
+static void mov_imm(int dst, uint32_t value) {
+    emit_rex(false, false, 0, 0, dst);
+    emit(0xB8 + (dst & 7));
+    emit32(value);
+}
+
+static void mov_imm64(int dst, uint64_t value) {
+    emit_rex(true, false, 0, 0, dst);
+    emit(0xB8 + (dst & 7));
+    memcpy(out, &value, 8);
+    out += 8;
+}
+
+static void lea(int dst, int base, int32_t disp) { emit_mem(0x8D, dst, (Mem) {base, NO_INDEX, disp}, false); }
+static void shl(int dst, Byte count) { emit_reg(0xC1, 4, dst, false); emit(count); }
+static void shr(int dst, Byte count) { emit_reg(0xC1, 5, dst, false); emit(count); }
+static void not(int dst) { emit_reg(0xF7, 2, dst, false); }
+static void zero_extend(int dst, int src) { emit_reg(0x0FB6, dst, src, true); }
+static void set_cc(enum Condition cc, int dst) { emit_reg(0x0F90 | cc, 0, dst, true); }
+
+static Byte *jump_cc(enum Condition cc) {
+    emit(0x0F);
+    emit(0x80 | cc);
+    emit32(0);
+    return out - 4;
+}
+
+static Byte *jump(void) {
+    emit(0xE9);
+    emit32(0);
+    return out - 4;
+}
+
+static void patch(Byte *rel32, Byte *target) {
+    int32_t rel = (int32_t) (target - (rel32 + 4));
+    memcpy(rel32, &rel, 4);
+}
+
+/*Block compiler*/
+
+#define MAX_EXITS 2
+
+typedef struct {
+    Byte *exits[MAX_EXITS];             // Jumps to the epilogue
+    int exit_count;
+    int cycles;                         // Base cycles of the instructions so far
+    int extra;                          // Most cycles page crosses and a taken branch can add
+    Word start;
+    const CPU *cpu;                     // Memory map the block is compiled against
+    bool writes;                        // Stores to RAM or pushes on the stack
+    bool loops;                         // Can jump back to its own start
+} Block_state;
+
+enum Compile_result { UNSUPPORTED, COMPILED, ENDS_BLOCK };
+
+static bool rom_page(const CPU *cpu, int page) {
+    // Read-only PRG, host memory that only changes with the banks
+    return page >= 0x80 && page <= 0xFF && cpu->read_pages[page] && !cpu->write_pages[page];
+}
+
+static Byte *rom_host(const CPU *cpu, Word address) {
+    return &cpu->read_pages[address >> 8][address & 0xFF];
+}
+
+static void set_zn(int reg) {
+    store_byte(FIELD(n_result), reg);
+    store_byte(FIELD(z_result), reg);
+}
+
+static void exit_block(Block_state *state, Word pc, int cycles, bool last) {
+    // ECX carries the next PC to the epilogue
+    mov_imm(RCX, pc);
+    alu_imm(ALU_ADD, REG_CYCLES, cycles);
+    if (!last) state->exits[state->exit_count++] = jump();
+}
+
+static void page_penalty(int index, Word address) {
+    // One more cycle when the low byte of the address carries into the high byte
+    lea(RAX, index, address & 0xFF);
+    shr(RAX, 8);
+    alu(ALU_ADD, REG_CYCLES, RAX);
+}
+
+// Emits the address of a RAM or PRG-ROM operand, false when the access could reach anything else
+static bool operand_address(const CPU *cpu, const Opcode_info *info, Word operand, bool write, Mem *mem, int *extra) {
+    int index = (info->mode == MODE_ABX || info->mode == MODE_ZPX) ? REG_X : REG_Y;
+    bool penalty = info->page_penalty && info->class == CLASS_READ;
+    switch (info->mode) {
+        case MODE_ZP0:
+            *mem = RAM(NO_INDEX, operand & 0xFF);
+            return true;
+
+        case MODE_ZPX:
+        case MODE_ZPY:
+            lea(RCX, index, operand & 0xFF);
+            zero_extend(RCX, RCX);
+            *mem = RAM(RCX, 0);
+            return true;
+
+        case MODE_ABS:
+            if (operand < 0x2000) {
+                *mem = RAM(NO_INDEX, operand & 0x7FF);
+                return true;
+            }
+            if (write || !rom_page(cpu, operand >> 8)) return false;
+            mov_imm64(RDI, (uint64_t) (uintptr_t) rom_host(cpu, operand));
+            *mem = (Mem) {RDI, NO_INDEX, 0};
+            return true;
+
+        case MODE_ABX:
+        case MODE_ABY:
+            if (operand + 0xFF < 0x2000) {
+                if (penalty) { page_penalty(index, operand); *extra += 1; }
+                lea(RCX, index, operand);
+                alu_imm(ALU_AND, RCX, 0x7FF);
+                *mem = RAM(RCX, 0);
+                return true;
+            }
+            // Both pages the index can reach have to be PRG-ROM, back to back in host memory
+            if (write || operand + 0xFF > 0xFFFF || !rom_page(cpu, operand >> 8)) return false;
+            if ((operand & 0xFF) && (!rom_page(cpu, (operand >> 8) + 1) ||
+                cpu->read_pages[(operand >> 8) + 1] != cpu->read_pages[operand >> 8] + 0x100))
+                return false;
+            if (penalty) { page_penalty(index, operand); *extra += 1; }
+            mov_imm64(RDI, (uint64_t) (uintptr_t) rom_host(cpu, operand));
+            *mem = (Mem) {RDI, index, 0};
+            return true;
+
+        default:
+            return false;                   // Indirect modes can point anywhere
+    }
+}
+
+static void add_with_carry(void) {
+    // sum = A + value + C in EAX, with the interpreter's carry (sum > 256) and zero (9 bit sum) rules
+    alu(ALU_MOV, RAX, REG_A);
+    alu(ALU_ADD, RAX, RDX);
+    alu(ALU_ADD, RAX, REG_C);
+    alu(ALU_XOR, REG_C, REG_C);
+    alu_imm(ALU_CMP, RAX, 256);
+    set_cc(CC_A, REG_C);
+    alu(ALU_MOV, RCX, RAX);
+    shr(RCX, 8);
+    alu(ALU_OR, RCX, RAX);
+    store_byte(FIELD(z_result), RCX);
+    // v_result = ~(A ^ value) & (A ^ sum)
+    alu(ALU_MOV, RCX, REG_A);
+    alu(ALU_XOR, RCX, RDX);
+    not(RCX);
+    alu(ALU_MOV, RDI, REG_A);
+    alu(ALU_XOR, RDI, RAX);
+    alu(ALU_AND, RCX, RDI);
+    store_byte(FIELD(v_result), RCX);
+    store_byte(FIELD(n_result), RAX);
+    zero_extend(REG_A, RAX);
+}
+
+static void compare(int reg) {
+    alu(ALU_XOR, REG_C, REG_C);
+    alu(ALU_CMP, reg, RDX);
+    set_cc(CC_AE, REG_C);
+    alu(ALU_MOV, RAX, reg);
+    alu(ALU_SUB, RAX, RDX);
+    set_zn(RAX);
+}
+
+// Shifts and rotates on the value in reg, the memory forms keep the interpreter's ASL quirk (shift right)
+static void shift(enum Operation operation, int reg, bool memory) {
+    alu(ALU_MOV, REG_C, reg);
+    if (operation == OP_ASL || operation == OP_ROL) shr(REG_C, 7);
+    else alu_imm(ALU_AND, REG_C, 1);
+
+    if (operation == OP_ASL && !memory) shl(reg, 1);
+    else if (operation == OP_ROL) { shl(reg, 1); alu(ALU_OR, reg, REG_C); }
+    else shr(reg, 1);
+    if (operation == OP_ROR) {
+        alu(ALU_MOV, RAX, REG_C);
+        shl(RAX, 7);
+        alu(ALU_OR, reg, RAX);
+    }
+    zero_extend(reg, reg);
+}
+
+static void stack_step(int delta) {
+    // EAX holds SP, which stays inside $0100 - $01FF
+    alu_imm(ALU_ADD, RAX, delta);
+    alu_imm(ALU_AND, RAX, 0xFF);
+    alu_imm(ALU_OR, RAX, 0x100);
+}
+
+static enum Compile_result compile_instruction(Block_state *state, Word pc, const Byte *bytes) {
+    const Opcode_info *info = &opcode_info[bytes[0]];
+    Word operand = (mode_sizes[info->mode] == 3) ? (bytes[1] | (bytes[2] << 8)) : bytes[1];
+    Word next = pc + mode_sizes[info->mode];
+    int cycles = state->cycles + info->cycles, extra = 0;
+    Mem mem = {0};
+    if (info->class == CLASS_WRITE || info->class == CLASS_RMW || info->operation == OP_PHA || info->operation == OP_JSR)
+        state->writes = true;
+
+    if (info->class != CLASS_NONE && info->mode != MODE_IMM) {
+        if (!operand_address(state->cpu, info, operand, info->class != CLASS_READ, &mem, &extra))
+            return UNSUPPORTED;
+    }
+    if (info->class == CLASS_READ || info->class == CLASS_RMW) {
+        if (info->mode == MODE_IMM) mov_imm(RDX, operand);
+        else load_byte(RDX, mem);
+    }
+
+    switch (info->operation) {
+        case OP_LDA: alu(ALU_MOV, REG_A, RDX); set_zn(REG_A); break;
+        case OP_LDX: alu(ALU_MOV, REG_X, RDX); set_zn(REG_X); break;
+        case OP_LDY: alu(ALU_MOV, REG_Y, RDX); set_zn(REG_Y); break;
+        case OP_STA: store_byte(mem, REG_A); break;
+        case OP_STX: store_byte(mem, REG_X); break;
+        case OP_STY: store_byte(mem, REG_Y); break;
+
+        case OP_AND: alu(ALU_AND, REG_A, RDX); set_zn(REG_A); break;
+        case OP_EOR: alu(ALU_XOR, REG_A, RDX); set_zn(REG_A); break;
+        case OP_ORA: alu(ALU_OR, REG_A, RDX); set_zn(REG_A); break;
+        case OP_ADC: add_with_carry(); break;
+        case OP_SBC: alu_imm(ALU_XOR, RDX, 0xFF); add_with_carry(); break;
+        case OP_CMP: compare(REG_A); break;
+        case OP_CPX: compare(REG_X); break;
+        case OP_CPY: compare(REG_Y); break;
+
+        case OP_BIT:
+            store_byte(FIELD(n_result), RDX);
+            alu(ALU_MOV, RAX, RDX);
+            shl(RAX, 1);
+            store_byte(FIELD(v_result), RAX);
+            alu(ALU_AND, RDX, REG_A);
+            store_byte(FIELD(z_result), RDX);
+            break;
+
+        case OP_ASL: case OP_LSR: case OP_ROL: case OP_ROR:
+            if (info->mode == MODE_ACC) {
+                shift(info->operation, REG_A, false);
+                set_zn(REG_A);
+            }
+            else {
+                shift(info->operation, RDX, true);
+                set_zn(RDX);
+                store_byte(mem, RDX);
+            }
+            break;
+
+        case OP_INC: case OP_DEC:
+            alu_imm(ALU_ADD, RDX, (info->operation == OP_INC) ? 1 : -1);
+            zero_extend(RDX, RDX);
+            store_byte(mem, RDX);
+            set_zn(RDX);
+            break;
+
+        case OP_INX: alu_imm(ALU_ADD, REG_X, 1); zero_extend(REG_X, REG_X); set_zn(REG_X); break;
+        case OP_INY: alu_imm(ALU_ADD, REG_Y, 1); zero_extend(REG_Y, REG_Y); set_zn(REG_Y); break;
+        case OP_DEX: alu_imm(ALU_ADD, REG_X, -1); zero_extend(REG_X, REG_X); set_zn(REG_X); break;
+        case OP_DEY: alu_imm(ALU_ADD, REG_Y, -1); zero_extend(REG_Y, REG_Y); set_zn(REG_Y); break;
+
+        case OP_TAX: alu(ALU_MOV, REG_X, REG_A); set_zn(REG_X); break;
+        case OP_TAY: alu(ALU_MOV, REG_Y, REG_A); set_zn(REG_Y); break;
+        case OP_TXA: alu(ALU_MOV, REG_A, REG_X); set_zn(REG_A); break;
+        case OP_TYA: alu(ALU_MOV, REG_A, REG_Y); set_zn(REG_A); break;
+        case OP_TSX: load_byte(REG_X, FIELD(SP)); set_zn(REG_X); break;
+        case OP_TXS:
+            alu(ALU_MOV, RAX, REG_X);
+            alu_imm(ALU_OR, RAX, 0x100);
+            store_word(FIELD(SP), RAX);
+            break;
+
+        case OP_CLC: alu(ALU_XOR, REG_C, REG_C); break;
+        case OP_SEC: mov_imm(REG_C, 1); break;
+        case OP_CLV: store_imm(FIELD(v_result), 0); break;
+        case OP_CLD: alu_mem_imm(ALU_AND, FIELD(P), (Byte) ~FLAG_D); break;
+        case OP_SED: alu_mem_imm(ALU_OR, FIELD(P), FLAG_D); break;
+        case OP_SEI: alu_mem_imm(ALU_OR, FIELD(P), FLAG_I); break;
+        case OP_NOP: break;
+
+        case OP_PHA:
+            load_word(RAX, FIELD(SP));
+            store_byte(RAM(RAX, 0), REG_A);
+            stack_step(-1);
+            store_word(FIELD(SP), RAX);
+            break;
+
+        case OP_PLA:
+            load_word(RAX, FIELD(SP));
+            stack_step(1);
+            store_word(FIELD(SP), RAX);
+            load_byte(REG_A, RAM(RAX, 0));
+            set_zn(REG_A);
+            break;
+
+        case OP_BCC: case OP_BCS: case OP_BEQ: case OP_BNE: case OP_BMI: case OP_BPL: case OP_BVC: case OP_BVS: {
+            Word target = next + (int8_t) operand;
+            enum Condition taken;
+            switch (info->operation) {
+                case OP_BCC: alu(0x85, REG_C, REG_C); taken = CC_E; break;     // test esi, esi
+                case OP_BCS: alu(0x85, REG_C, REG_C); taken = CC_NE; break;
+                case OP_BEQ: alu_mem_imm(ALU_CMP, FIELD(z_result), 0); taken = CC_E; break;
+                case OP_BNE: alu_mem_imm(ALU_CMP, FIELD(z_result), 0); taken = CC_NE; break;
+                case OP_BMI: test_mem_imm(FIELD(n_result), 0x80); taken = CC_NE; break;
+                case OP_BPL: test_mem_imm(FIELD(n_result), 0x80); taken = CC_E; break;
+                case OP_BVS: test_mem_imm(FIELD(v_result), 0x80); taken = CC_NE; break;
+                default: test_mem_imm(FIELD(v_result), 0x80); taken = CC_E; break;
+            }
+            Byte *branch = jump_cc(taken);
+            exit_block(state, next, cycles, false);
+            patch(branch, out);
+            exit_block(state, target, cycles + (((next & 0xFF00) != (target & 0xFF00)) ? 2 : 1), true);
+            state->extra += 2;
+            state->loops = (target == state->start);
+            state->cycles = cycles;
+            return ENDS_BLOCK;
+        }
+
+        case OP_JMP:
+            if (info->mode != MODE_ABS) return UNSUPPORTED;
+            exit_block(state, operand, cycles, true);
+            state->loops = (operand == state->start);
+            state->cycles = cycles;
+            return ENDS_BLOCK;
+
+        case OP_JSR:
+            load_word(RAX, FIELD(SP));
+            store_imm(RAM(RAX, 0), (Byte) ((next - 1) >> 8));
+            stack_step(-1);
+            store_imm(RAM(RAX, 0), (Byte) (next - 1));
+            stack_step(-1);
+            store_word(FIELD(SP), RAX);
+            exit_block(state, operand, cycles, true);
+            state->cycles = cycles;
+            return ENDS_BLOCK;
+
+        case OP_RTS:
+            load_word(RAX, FIELD(SP));
+            stack_step(1);
+            load_byte(RDX, RAM(RAX, 0));
+            stack_step(1);
+            load_byte(RCX, RAM(RAX, 0));
+            store_word(FIELD(SP), RAX);
+            shl(RCX, 8);
+            alu(ALU_OR, RCX, RDX);
+            alu_imm(ALU_ADD, RCX, 1);
+            alu_imm(ALU_ADD, REG_CYCLES, cycles);
+            state->cycles = cycles;
+            return ENDS_BLOCK;
+
+        default:
+            return UNSUPPORTED;                 // BRK, CLI, PHP, PLP and RTI deal with interrupts
+    }
+    state->cycles = cycles;
+    state->extra += extra;
+    return COMPILED;
+}
+
+static Jit_block *compile_block(Jit *jit, const CPU *cpu, Word start) {
+    if (jit->blocks_used == JIT_MAX_BLOCKS || jit->code_used + JIT_BLOCK_CODE_MAX > JIT_CODE_SIZE)
+        clear_blocks(jit);
+    Jit_block *block = &jit->block_pool[jit->blocks_used++];
+    *block = (Jit_block) {.code = NULL, .max_cycles = 0, .idle = false};
+    jit->blocks[start & 0x7FFF] = block;
+
+    Block_state state = {.exit_count = 0, .cycles = 0, .extra = 0, .start = start, .cpu = cpu,
+                         .writes = false, .loops = false};
+    Byte *entry = jit->code_buffer + jit->code_used;
+    out = entry;
+
+    emit(0x50 + RBX);
+    emit(0x50 + RSI);
+    emit(0x50 + RDI);
+    emit_rex(true, false, REG_ARG, 0, REG_CPU);
+    emit(ALU_MOV);
+    emit(0xC0 | ((REG_ARG & 7) << 3) | (REG_CPU & 7));  // mov r11, REG_ARG
+    alu(ALU_XOR, REG_CYCLES, REG_CYCLES);
+    load_byte(REG_A, FIELD(A));
+    load_byte(REG_X, FIELD(X));
+    load_byte(REG_Y, FIELD(Y));
+    load_byte(REG_C, FIELD(P));
+    alu_imm(ALU_AND, REG_C, FLAG_C);
+
+    Word pc = start;
+    int count = 0;
+    enum Compile_result result = UNSUPPORTED;
+    while (count < JIT_BLOCK_LENGTH) {
+        // Every byte of the instruction has to come from PRG-ROM and it can't wrap past $FFFF
+        if (!rom_page(cpu, pc >> 8)) break;
+        Byte bytes[3] = {*rom_host(cpu, pc), 0, 0};
+        const Opcode_info *info = &opcode_info[bytes[0]];
+        int size = mode_sizes[info->mode];
+        if (!info->legal || pc + size > 0xFFFF) break;
+        bool readable = true;
+        for (int i = 1; i < size; i++) {
+            if (!rom_page(cpu, (Word) (pc + i) >> 8)) readable = false;
+            else bytes[i] = *rom_host(cpu, pc + i);
+        }
+        if (!readable) break;
+
+        Byte *mark = out;
+        result = compile_instruction(&state, pc, bytes);
+        if (result == UNSUPPORTED) {
+            out = mark;
+            break;
+        }
+        count++;
+        pc += size;
+        if (result == ENDS_BLOCK) break;
+    }
+    if (count == 0)
+        return block;
+    if (result != ENDS_BLOCK)
+        exit_block(&state, pc, state.cycles, true);
+
+    // Epilogue, ECX holds the next PC and EBX the cycles run
+    for (int i = 0; i < state.exit_count; i++)
+        patch(state.exits[i], out);
+    store_byte(FIELD(A), REG_A);
+    store_byte(FIELD(X), REG_X);
+    store_byte(FIELD(Y), REG_Y);
+    load_byte(RAX, FIELD(P));
+    alu_imm(ALU_AND, RAX, (Byte) ~FLAG_C);
+    alu(ALU_OR, RAX, REG_C);
+    store_byte(FIELD(P), RAX);
+    store_word(FIELD(PC), RCX);
+    alu(ALU_MOV, RAX, REG_CYCLES);
+    emit(0x58 + RDI);
+    emit(0x58 + RSI);
+    emit(0x58 + RBX);
+    emit(0xC3);
+
+    block->code = (Block_code) (void *) entry;
+    block->max_cycles = state.cycles + state.extra;
+    block->idle = state.loops && !state.writes;
+    jit->code_used = out - jit->code_buffer;
+    return block;
+}
+
+#else
+
+bool init_jit(Emulator *emu) {
+    (void) emu;
+    return false;
+}
+
+void execute_jit(Emulator *emu) {
+    execute_instructions(emu);
+}
+
+void jit_flush(Emulator *emu) { (void) emu; }
+
+void exit_jit(Emulator *emu) { (void) emu; }
+
+#endif
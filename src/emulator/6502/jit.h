@@ -0,0 +1,25 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <stdbool.h>
+
+#include "../../types.h"
+
+/* Recompiler for hot PRG-ROM basic blocks on x86-64 hosts. Blocks only touch RAM and PRG-ROM, anything
+   else (I/O registers, indirect addressing, interrupt flag changes, code in RAM) runs on the interpreter */
+
+// Block cache of one emulator instance
+typedef struct Jit Jit;
+
+// Allocates the block cache of emu, false when the host can't run recompiled blocks
+bool init_jit(Emulator *emu);
+
+// Runs until the master clock reaches next_event_cycle, the same contract as execute_instructions()
+void execute_jit(Emulator *emu);
+
+// Drops every compiled block, PRG banks have been switched
+void jit_flush(Emulator *emu);
+
+void exit_jit(Emulator *emu);
+
+#endif // !JIT_H
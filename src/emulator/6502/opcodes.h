@@ -0,0 +1,186 @@
+#ifndef OPCODES_H
+#define OPCODES_H
+
+/* Opcode table, expanded by instructions.c into one specialized handler per opcode and the dispatch table
+   X(opcode, addressing mode, operation, base cycles, page cross penalty, bus access class) */
+
+// READ: operand read on the last cycle, WRITE: result written on the last cycle,
+// RMW: read three cycles before the end and written back on the last cycle, NONE: no operand access
+#define CLASS_NONE 0
+#define CLASS_READ 1
+#define CLASS_WRITE 2
+#define CLASS_RMW 3
+
+#define OPCODE_TABLE(X)                 \
+    X(00, IMP, BRK, 7, 0, NONE)         \
+    X(01, IZX, ORA, 6, 0, READ)         \
+    X(05, ZP0, ORA, 3, 0, READ)         \
+    X(06, ZP0, ASL, 5, 0, RMW)          \
+    X(08, IMP, PHP, 3, 0, NONE)         \
+    X(09, IMM, ORA, 2, 0, READ)         \
+    X(0A, ACC, ASL, 2, 0, NONE)         \
+    X(0D, ABS, ORA, 4, 0, READ)         \
+    X(0E, ABS, ASL, 6, 0, RMW)          \
+    X(10, REL, BPL, 2, 0, NONE)         \
+    X(11, IZY, ORA, 5, 1, READ)         \
+    X(15, ZPX, ORA, 4, 0, READ)         \
+    X(16, ZPX, ASL, 6, 0, RMW)          \
+    X(18, IMP, CLC, 2, 0, NONE)         \
+    X(19, ABY, ORA, 4, 1, READ)         \
+    X(1D, ABX, ORA, 4, 1, READ)         \
+    X(1E, ABX, ASL, 7, 0, RMW)          \
+    X(20, ABS, JSR, 6, 0, NONE)         \
+    X(21, IZX, AND, 6, 0, READ)         \
+    X(24, ZP0, BIT, 3, 0, READ)         \
+    X(25, ZP0, AND, 3, 0, READ)         \
+    X(26, ZP0, ROL, 5, 0, RMW)          \
+    X(28, IMP, PLP, 4, 0, NONE)         \
+    X(29, IMM, AND, 2, 0, READ)         \
+    X(2A, ACC, ROL, 2, 0, NONE)         \
+    X(2C, ABS, BIT, 4, 0, READ)         \
+    X(2D, ABS, AND, 4, 0, READ)         \
+    X(2E, ABS, ROL, 6, 0, RMW)          \
+    X(30, REL, BMI, 2, 0, NONE)         \
+    X(31, IZY, AND, 5, 1, READ)         \
+    X(35, ZPX, AND, 4, 0, READ)         \
+    X(36, ZPX, ROL, 6, 0, RMW)          \
+    X(38, IMP, SEC, 2, 0, NONE)         \
+    X(39, ABY, AND, 4, 1, READ)         \
+    X(3D, ABX, AND, 4, 1, READ)         \
+    X(3E, ABX, ROL, 7, 0, RMW)          \
+    X(40, IMP, RTI, 6, 0, NONE)         \
+    X(41, IZX, EOR, 6, 0, READ)         \
+    X(45, ZP0, EOR, 3, 0, READ)         \
+    X(46, ZP0, LSR, 5, 0, RMW)          \
+    X(48, IMP, PHA, 3, 0, NONE)         \
+    X(49, IMM, EOR, 2, 0, READ)         \
+    X(4A, ACC, LSR, 2, 0, NONE)         \
+    X(4C, ABS, JMP, 3, 0, NONE)         \
+    X(4D, ABS, EOR, 4, 0, READ)         \
+    X(4E, ABS, LSR, 6, 0, RMW)          \
+    X(50, REL, BVC, 2, 0, NONE)         \
+    X(51, IZY, EOR, 5, 1, READ)         \
+    X(55, ZPX, EOR, 4, 0, READ)         \
+    X(56, ZPX, LSR, 6, 0, RMW)          \
+    X(58, IMP, CLI, 2, 0, NONE)         \
+    X(59, ABY, EOR, 4, 1, READ)         \
+    X(5D, ABX, EOR, 4, 1, READ)         \
+    X(5E, ABX, LSR, 7, 0, RMW)          \
+    X(60, IMP, RTS, 6, 0, NONE)         \
+    X(61, IZX, ADC, 6, 0, READ)         \
+    X(65, ZP0, ADC, 3, 0, READ)         \
+    X(66, ZP0, ROR, 5, 0, RMW)          \
+    X(68, IMP, PLA, 4, 0, NONE)         \
+    X(69, IMM, ADC, 2, 0, READ)         \
+    X(6A, ACC, ROR, 2, 0, NONE)         \
+    X(6C, IND, JMP, 5, 0, NONE)         \
+    X(6D, ABS, ADC, 4, 0, READ)         \
+    X(6E, ABS, ROR, 6, 0, RMW)          \
+    X(70, REL, BVS, 2, 0, NONE)         \
+    X(71, IZY, ADC, 5, 1, READ)         \
+    X(75, ZPX, ADC, 4, 0, READ)         \
+    X(76, ZPX, ROR, 6, 0, RMW)          \
+    X(78, IMP, SEI, 2, 0, NONE)         \
+    X(79, ABY, ADC, 4, 1, READ)         \
+    X(7D, ABX, ADC, 4, 1, READ)         \
+    X(7E, ABX, ROR, 7, 0, RMW)          \
+    X(81, IZX, STA, 6, 0, WRITE)        \
+    X(84, ZP0, STY, 3, 0, WRITE)        \
+    X(85, ZP0, STA, 3, 0, WRITE)        \
+    X(86, ZP0, STX, 3, 0, WRITE)        \
+    X(88, IMP, DEY, 2, 0, NONE)         \
+    X(8A, IMP, TXA, 2, 0, NONE)         \
+    X(8C, ABS, STY, 4, 0, WRITE)        \
+    X(8D, ABS, STA, 4, 0, WRITE)        \
+    X(8E, ABS, STX, 4, 0, WRITE)        \
+    X(90, REL, BCC, 2, 0, NONE)         \
+    X(91, IZY, STA, 6, 0, WRITE)        \
+    X(94, ZPX, STY, 4, 0, WRITE)        \
+    X(95, ZPX, STA, 4, 0, WRITE)        \
+    X(96, ZPY, STX, 4, 0, WRITE)        \
+    X(98, IMP, TYA, 2, 0, NONE)         \
+    X(99, ABY, STA, 5, 0, WRITE)        \
+    X(9A, IMP, TXS, 2, 0, NONE)         \
+    X(9D, ABX, STA, 5, 0, WRITE)        \
+    X(A0, IMM, LDY, 2, 0, READ)         \
+    X(A1, IZX, LDA, 6, 0, READ)         \
+    X(A2, IMM, LDX, 2, 0, READ)         \
+    X(A4, ZP0, LDY, 3, 0, READ)         \
+    X(A5, ZP0, LDA, 3, 0, READ)         \
+    X(A6, ZP0, LDX, 3, 0, READ)         \
+    X(A8, IMP, TAY, 2, 0, NONE)         \
+    X(A9, IMM, LDA, 2, 0, READ)         \
+    X(AA, IMP, TAX, 2, 0, NONE)         \
+    X(AC, ABS, LDY, 4, 0, READ)         \
+    X(AD, ABS, LDA, 4, 0, READ)         \
+    X(AE, ABS, LDX, 4, 0, READ)         \
+    X(B0, REL, BCS, 2, 0, NONE)         \
+    X(B1, IZY, LDA, 5, 1, READ)         \
+    X(B4, ZPX, LDY, 4, 0, READ)         \
+    X(B5, ZPX, LDA, 4, 0, READ)         \
+    X(B6, ZPY, LDX, 4, 0, READ)         \
+    X(B8, IMP, CLV, 2, 0, NONE)         \
+    X(B9, ABY, LDA, 4, 1, READ)         \
+    X(BA, IMP, TSX, 2, 0, NONE)         \
+    X(BC, ABX, LDY, 4, 1, READ)         \
+    X(BD, ABX, LDA, 4, 1, READ)         \
+    X(BE, ABY, LDX, 4, 1, READ)         \
+    X(C0, IMM, CPY, 2, 0, READ)         \
+    X(C1, IZX, CMP, 6, 0, READ)         \
+    X(C4, ZP0, CPY, 3, 0, READ)         \
+    X(C5, ZP0, CMP, 3, 0, READ)         \
+    X(C6, ZP0, DEC, 5, 0, RMW)          \
+    X(C8, IMP, INY, 2, 0, NONE)         \
+    X(C9, IMM, CMP, 2, 0, READ)         \
+    X(CA, IMP, DEX, 2, 0, NONE)         \
+    X(CC, ABS, CPY, 4, 0, READ)         \
+    X(CD, ABS, CMP, 4, 0, READ)         \
+    X(CE, ABS, DEC, 6, 0, RMW)          \
+    X(D0, REL, BNE, 2, 0, NONE)         \
+    X(D1, IZY, CMP, 5, 1, READ)         \
+    X(D5, ZPX, CMP, 4, 0, READ)         \
+    X(D6, ZPX, DEC, 6, 0, RMW)          \
+    X(D8, IMP, CLD, 2, 0, NONE)         \
+    X(D9, ABY, CMP, 4, 1, READ)         \
+    X(DD, ABX, CMP, 4, 1, READ)         \
+    X(DE, ABX, DEC, 7, 0, RMW)          \
+    X(E0, IMM, CPX, 2, 0, READ)         \
+    X(E1, IZX, SBC, 6, 0, READ)         \
+    X(E4, ZP0, CPX, 3, 0, READ)         \
+    X(E5, ZP0, SBC, 3, 0, READ)         \
+    X(E6, ZP0, INC, 5, 0, RMW)          \
+    X(E8, IMP, INX, 2, 0, NONE)         \
+    X(E9, IMM, SBC, 2, 0, READ)         \
+    X(EA, IMP, NOP, 2, 0, NONE)         \
+    X(EC, ABS, CPX, 4, 0, READ)         \
+    X(ED, ABS, SBC, 4, 0, READ)         \
+    X(EE, ABS, INC, 6, 0, RMW)          \
+    X(F0, REL, BEQ, 2, 0, NONE)         \
+    X(F1, IZY, SBC, 5, 1, READ)         \
+    X(F5, ZPX, SBC, 4, 0, READ)         \
+    X(F6, ZPX, INC, 6, 0, RMW)          \
+    X(F8, IMP, SED, 2, 0, NONE)         \
+    X(F9, ABY, SBC, 4, 1, READ)         \
+    X(FD, ABX, SBC, 4, 1, READ)         \
+    X(FE, ABX, INC, 7, 0, RMW)
+
+/* Superinstructions, pairs common in game code that run back to back without a dispatch in between.
+   Each entry repeats both instructions' OPCODE_TABLE columns. The first one can't jump */
+#define FUSED_TABLE(X)                                                  \
+    X(A5, ZP0, LDA, 3, 0, READ,     8D, ABS, STA, 4, 0, WRITE)          \
+    X(A9, IMM, LDA, 2, 0, READ,     8D, ABS, STA, 4, 0, WRITE)          \
+    X(BD, ABX, LDA, 4, 1, READ,     9D, ABX, STA, 5, 0, WRITE)          \
+    X(B1, IZY, LDA, 5, 1, READ,     91, IZY, STA, 6, 0, WRITE)          \
+    X(AD, ABS, LDA, 4, 0, READ,     10, REL, BPL, 2, 0, NONE)           \
+    X(AD, ABS, LDA, 4, 0, READ,     30, REL, BMI, 2, 0, NONE)           \
+    X(CA, IMP, DEX, 2, 0, NONE,     D0, REL, BNE, 2, 0, NONE)           \
+    X(88, IMP, DEY, 2, 0, NONE,     D0, REL, BNE, 2, 0, NONE)           \
+    X(C8, IMP, INY, 2, 0, NONE,     C0, IMM, CPY, 2, 0, READ)           \
+    X(E8, IMP, INX, 2, 0, NONE,     E0, IMM, CPX, 2, 0, READ)           \
+    X(C0, IMM, CPY, 2, 0, READ,     D0, REL, BNE, 2, 0, NONE)           \
+    X(E0, IMM, CPX, 2, 0, READ,     D0, REL, BNE, 2, 0, NONE)           \
+    X(C9, IMM, CMP, 2, 0, READ,     D0, REL, BNE, 2, 0, NONE)           \
+    X(C9, IMM, CMP, 2, 0, READ,     F0, REL, BEQ, 2, 0, NONE)           \
+    X(29, IMM, AND, 2, 0, READ,     F0, REL, BEQ, 2, 0, NONE)
+
+#endif // !OPCODES_H
@@ -3,7 +3,7 @@
 
 #include "mapper.h"
 
-int load_cartridge(char* filename);
+int load_cartridge(Mapper *mapper, char* filename);
 
 void free_cartridge(Mapper *mapper);
 
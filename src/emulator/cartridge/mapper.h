@@ -7,14 +7,18 @@ enum Mappers {
     NROM = 0,
 };
 
+// Nametable layouts, map_nametables() turns them into the four slots the PPU reads through
 enum Mirror_type {
     HORIZONTAL,
-    VERTICAL
+    VERTICAL,
+    SINGLE_SCREEN_LOW,
+    SINGLE_SCREEN_HIGH,
+    FOUR_SCREEN                 // 4KB of VRAM on the cartridge, no mirroring
 };
 
 typedef struct Mapper{
     uint16_t mapper_num;
-    enum Mirror_type mirroring;
+    enum Mirror_type mirroring;     // Mappers switching it from cpu_write get their nametables remapped
     uint8_t PRG_ROM_banks;
     uint8_t *PRG_ROM_p;
     uint8_t CHR_ROM_banks;
@@ -23,6 +27,9 @@ typedef struct Mapper{
     uint8_t (*cpu_write)(struct Mapper *, uint16_t, uint8_t);
     uint8_t (*ppu_read)(struct Mapper *, uint16_t);
     uint8_t (*ppu_write)(struct Mapper *, uint16_t, uint8_t);
+    // Points the CPU pages at cartridge memory, pages left NULL go through cpu_read / cpu_write.
+    // A page mapped for reads but not for writes must not change until the hook runs again
+    void (*map_cpu_pages)(struct Mapper *, uint8_t *read_pages[256], uint8_t *write_pages[256]);
 } Mapper;
 
 int load_mapper_functions(Mapper *mapper, uint16_t mapper_num, enum Mirror_type mirror_type);
@@ -5,12 +5,14 @@ uint8_t _cpu_read(Mapper *mapper, uint16_t address);
 uint8_t _cpu_write(Mapper *mapper, uint16_t address, uint8_t data);
 uint8_t _ppu_read(Mapper *mapper, uint16_t address);
 uint8_t _ppu_write(Mapper *mapper, uint16_t address, uint8_t data);
+void _map_cpu_pages(Mapper *mapper, uint8_t *read_pages[256], uint8_t *write_pages[256]);
 
 void _load_NROM(Mapper *mapper) {
     mapper->cpu_read = _cpu_read;
     mapper->cpu_write = _cpu_write;
     mapper->ppu_read = _ppu_read;
     mapper->ppu_write = _ppu_write;
+    mapper->map_cpu_pages = _map_cpu_pages;
 }
 
 uint8_t _cpu_read(Mapper *mapper, uint16_t address) {
@@ -43,3 +45,11 @@ uint8_t _ppu_write(Mapper *mapper, uint16_t address, uint8_t data) {
     // TODO
     return 0;
 }
+
+void _map_cpu_pages(Mapper *mapper, uint8_t *read_pages[256], uint8_t *write_pages[256]) {
+    // PRG-ROM is read only, its write pages stay unmapped so writes keep going to _cpu_write
+    (void) write_pages;
+    uint16_t mask = (mapper->PRG_ROM_banks > 1) ? 0x7FFF : 0x3FFF;
+    for (int page = 0x80; page < 0x100; page++)
+        read_pages[page] = &mapper->PRG_ROM_p[(page << 8) & mask];
+}
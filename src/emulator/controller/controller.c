@@ -0,0 +1,21 @@
+#include "controller.h"
+#include "../emulator.h"
+
+void write_controller_strobe(Emulator *emu, Byte data) {
+    Controllers *controllers = &emu->controllers;
+    controllers->strobe = data & 0x1;
+    // Latching happens on every write, falling edge included
+    for (int port = 0; port < CONTROLLER_PORTS; port++)
+        controllers->shift[port] = controllers->buttons[port];
+}
+
+Byte read_controller(Emulator *emu, int port) {
+    Controllers *controllers = &emu->controllers;
+    if (controllers->strobe)
+        controllers->shift[port] = controllers->buttons[port];
+    Byte data = controllers->shift[port] & 0x1;
+    // Official controllers report 1 once all 8 buttons are out
+    if (!controllers->strobe)
+        controllers->shift[port] = (controllers->shift[port] >> 1) | 0x80;
+    return 0x40 | data;                 // Upper bits are open bus, the high byte of $4016
+}
@@ -0,0 +1,34 @@
+#ifndef CONTROLLER_H
+#define CONTROLLER_H
+
+#include <stdbool.h>
+
+#include "../../types.h"
+
+#define CONTROLLER_PORTS 2
+
+// Standard controller buttons, in the order the shift register reports them
+enum Button {
+    BUTTON_A = 0x01,
+    BUTTON_B = 0x02,
+    BUTTON_SELECT = 0x04,
+    BUTTON_START = 0x08,
+    BUTTON_UP = 0x10,
+    BUTTON_DOWN = 0x20,
+    BUTTON_LEFT = 0x40,
+    BUTTON_RIGHT = 0x80
+};
+
+typedef struct {
+    Byte buttons[CONTROLLER_PORTS];     // Held buttons, set by the frontend or a movie before each frame
+    Byte shift[CONTROLLER_PORTS];       // Latched buttons, shifted out one per read of $4016 / $4017
+    bool strobe;                        // Bit 0 of the last $4016 write, reloads the shift registers while set
+} Controllers;
+
+// $4016 write, latches both ports
+void write_controller_strobe(Emulator *emu, Byte data);
+
+// $4016 / $4017 read of port 0 / 1
+Byte read_controller(Emulator *emu, int port);
+
+#endif // !CONTROLLER_H
@@ -0,0 +1,46 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "emulator.h"
+#include "6502/instructions.h"
+
+Emulator *create_emulator(void) {
+    // Large enough (decode cache, screen buffer) that it never goes on the stack
+    Emulator *emu = calloc(1, sizeof(Emulator));
+    if (emu == NULL)
+        return NULL;
+    emu->execute = execute_instructions;
+    return emu;
+}
+
+void reset_console(Emulator *emu, bool power) {
+    if (power) {
+        // The cartridge, the texture and the held buttons survive, everything else starts over
+        SDL_Texture *texture = emu->ppu.ppu_draw_texture;
+        reset_cpu(emu);
+        reset_ppu(emu);
+        emu->ppu.ppu_draw_texture = texture;
+        memset(emu->controllers.shift, 0, sizeof(emu->controllers.shift));
+        emu->controllers.strobe = false;
+        emu->cycles = 0;
+        emu->cycle_overshoot = 0;
+        init_cpu(emu);
+        return;
+    }
+    // The reset line leaves RAM alone, the CPU skips three stack pushes and the PPU drops CTRL and MASK
+    CPU *cpu = &emu->cpu;
+    sync_ppu(emu);
+    cpu_to_ppu_write(emu, 0x2000, 0);
+    cpu_to_ppu_write(emu, 0x2001, 0);
+    emu->ppu.write_latch = 0;
+    cpu->SP = 0x0100 | ((cpu->SP - 3) & 0xFF);
+    cpu->P |= FLAG_I;
+    cpu->PC = cpu_read_byte(emu, 0xFFFC) | ((Word) cpu_read_byte(emu, 0xFFFD) << 8);
+}
+
+void destroy_emulator(Emulator *emu) {
+    if (emu == NULL)
+        return;
+    exit_cpu(emu);
+    free(emu);
+}
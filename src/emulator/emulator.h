@@ -0,0 +1,36 @@
+#ifndef EMULATOR_H
+#define EMULATOR_H
+
+#include "6502/6502.h"
+#include "ppu/ppu.h"
+#include "controller/controller.h"
+#include "cartridge/mapper.h"
+#include "scheduler/scheduler.h"
+#include "profile.h"
+
+/* Everything one console owns. CPU, PPU, scheduler and JIT functions take the instance they work on,
+   so independent instances can run side by side, each one on a single thread at a time */
+struct Emulator {
+    CPU cpu;
+    PPU ppu;
+    Mapper mapper;
+    Controllers controllers;
+    Scheduler scheduler;
+    int64_t cycles;                     // Master clock, in CPU cycles
+    int64_t cycle_overshoot;            // Cycles run past the previous run_cycles budget
+    void (*execute)(Emulator *emu);     // CPU backend, see set_cpu_backend()
+    struct Jit *jit;                    // NULL until the JIT backend is selected
+    uint64_t fused_dispatches;          // Dispatches saved by fused instruction pairs
+    Profile profile;
+};
+
+// Zeroed instance on the interpreter backend, NULL when out of memory
+Emulator *create_emulator(void);
+
+// Power cycle clears RAM, VRAM and the clock, the reset button only restarts the CPU at the reset vector
+void reset_console(Emulator *emu, bool power);
+
+// Frees the cartridge, the JIT and the instance itself
+void destroy_emulator(Emulator *emu);
+
+#endif // !EMULATOR_H
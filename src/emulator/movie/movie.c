@@ -0,0 +1,331 @@
+#include <string.h>
+
+#include "movie.h"
+#include "../emulator.h"
+#include "../savestate/savestate.h"
+#include "../../utils.h"
+
+#define MOVIE_MAGIC "NESM"
+#define MOVIE_HEADER_SIZE (4 + 2 + 2 + 8 + 4 + 4 + 4)
+#define MOVIE_FRAME_SIZE (1 + CONTROLLER_PORTS)
+#define MOVIE_CHECKPOINT_SIZE (4 + 8)
+#define FM2_LINE_MAX 1024
+#define FM2_BUTTONS "RLDUTSBA"          // Gamepad field order, bit 7 to bit 0 of the shift register
+
+typedef struct {
+    Byte commands;
+    Byte buttons[CONTROLLER_PORTS];
+} Movie_frame;
+
+typedef struct {
+    uint32_t frame;                     // Frames run before the hash was taken
+    uint64_t hash;                      // FNV-1a of the savestate
+} Movie_checkpoint;
+
+struct Movie {
+    Movie_frame *frames;
+    uint32_t frame_count;
+    uint32_t frame_capacity;
+    Movie_checkpoint *checkpoints;
+    uint32_t checkpoint_count;
+    uint32_t checkpoint_capacity;
+    uint32_t checkpoint_interval;       // 0 when recording without checkpoints
+    uint64_t rom_hash;                  // 0 for imported movies, they aren't checked against the cartridge
+    bool recording;
+    uint32_t position;                  // Next frame to record or play
+    uint32_t next_checkpoint;           // Next checkpoint to compare during playback
+    uint32_t verified;
+    Byte *state;                        // Savestate buffer for hashing
+};
+
+static Movie *alloc_movie(void);
+static int load_native(Movie *movie, FILE *movie_file, const char *path);
+static int load_fm2(Movie *movie, FILE *movie_file, const char *path);
+static int append_frame(Movie *movie, Movie_frame frame);
+static int append_checkpoint(Movie *movie, Movie_checkpoint checkpoint);
+static int check_state(Movie *movie, const Emulator *emu);
+static uint64_t state_hash(Movie *movie, const Emulator *emu);
+static uint64_t rom_hash(const Emulator *emu);
+static void put_u32(Byte *out, uint32_t data);
+static void put_u64(Byte *out, uint64_t data);
+static uint32_t get_u32(const Byte *in);
+static uint64_t get_u64(const Byte *in);
+
+Movie *create_movie(const Emulator *emu, uint32_t checkpoint_interval) {
+    Movie *movie = alloc_movie();
+    if (movie == NULL)
+        return NULL;
+    movie->recording = true;
+    movie->checkpoint_interval = checkpoint_interval;
+    movie->rom_hash = rom_hash(emu);
+    return movie;
+}
+
+Movie *load_movie(const char *path) {
+    FILE *movie_file = fopen(path, "rb");
+    if (movie_file == NULL) {
+        ERROR("Unable to open movie: \"%s\"", path);
+        return NULL;
+    }
+    Movie *movie = alloc_movie();
+    if (movie == NULL) {
+        fclose(movie_file);
+        return NULL;
+    }
+    char magic[4] = {0};
+    fread(magic, 1, 4, movie_file);
+    rewind(movie_file);
+    int status = (memcmp(magic, MOVIE_MAGIC, 4) == 0) ? load_native(movie, movie_file, path)
+                                                      : load_fm2(movie, movie_file, path);
+    fclose(movie_file);
+    if (status < 0) {
+        destroy_movie(movie);
+        return NULL;
+    }
+    return movie;
+}
+
+int save_movie(const Movie *movie, const char *path) {
+    FILE *movie_file = fopen(path, "wb");
+    if (movie_file == NULL)
+        ERROR_RETURN("Unable to open movie for writing: \"%s\"", path);
+
+    Byte header[MOVIE_HEADER_SIZE] = {0};
+    memcpy(header, MOVIE_MAGIC, 4);
+    header[4] = (Byte) MOVIE_VERSION;
+    header[5] = (Byte) (MOVIE_VERSION >> 8);
+    put_u64(header + 8, movie->rom_hash);
+    put_u32(header + 16, movie->frame_count);
+    put_u32(header + 20, movie->checkpoint_interval);
+    put_u32(header + 24, movie->checkpoint_count);
+    fwrite(header, 1, sizeof(header), movie_file);
+
+    for (uint32_t i = 0; i < movie->frame_count; i++) {
+        Byte record[MOVIE_FRAME_SIZE] = {movie->frames[i].commands};
+        memcpy(record + 1, movie->frames[i].buttons, CONTROLLER_PORTS);
+        fwrite(record, 1, sizeof(record), movie_file);
+    }
+    for (uint32_t i = 0; i < movie->checkpoint_count; i++) {
+        Byte record[MOVIE_CHECKPOINT_SIZE];
+        put_u32(record, movie->checkpoints[i].frame);
+        put_u64(record + 4, movie->checkpoints[i].hash);
+        fwrite(record, 1, sizeof(record), movie_file);
+    }
+
+    int status = ferror(movie_file) ? -1 : 0;
+    if (fclose(movie_file) != 0 || status < 0)
+        ERROR_RETURN("Unable to write movie: \"%s\"", path);
+    return 0;
+}
+
+void destroy_movie(Movie *movie) {
+    if (movie == NULL)
+        return;
+    free(movie->frames);
+    free(movie->checkpoints);
+    free(movie->state);
+    free(movie);
+}
+
+int movie_next_frame(Movie *movie, Emulator *emu, Byte commands) {
+    if (movie->position == 0 && movie->rom_hash && movie->rom_hash != rom_hash(emu))
+        ERROR_RETURN("Movie was recorded on another cartridge (ROM hash %016llx)",
+                     (unsigned long long) movie->rom_hash);
+    if (check_state(movie, emu) < 0)
+        return -1;
+
+    Movie_frame frame = {.commands = commands};
+    if (movie->recording) {
+        memcpy(frame.buttons, emu->controllers.buttons, CONTROLLER_PORTS);
+        if (append_frame(movie, frame) < 0)
+            return -1;
+    }
+    else {
+        if (movie->position >= movie->frame_count)
+            return 1;
+        frame = movie->frames[movie->position];
+        memcpy(emu->controllers.buttons, frame.buttons, CONTROLLER_PORTS);
+    }
+    movie->position++;
+
+    if (frame.commands & (MOVIE_POWER | MOVIE_RESET))
+        reset_console(emu, frame.commands & MOVIE_POWER);
+    return 0;
+}
+
+int movie_finish(Movie *movie, const Emulator *emu) {
+    if (movie->recording && movie->checkpoint_interval && movie->position % movie->checkpoint_interval) {
+        // The last frames always get a checkpoint, a desync near the end still shows
+        Movie_checkpoint checkpoint = {.frame = movie->position, .hash = state_hash(movie, emu)};
+        return append_checkpoint(movie, checkpoint);
+    }
+    return check_state(movie, emu);
+}
+
+uint32_t movie_length(const Movie *movie) {
+    return movie->frame_count;
+}
+
+uint32_t movie_position(const Movie *movie) {
+    return movie->position;
+}
+
+uint32_t movie_verified(const Movie *movie) {
+    return movie->verified;
+}
+
+static Movie *alloc_movie(void) {
+    Movie *movie = calloc(1, sizeof(Movie));
+    if (movie == NULL || (movie->state = malloc(savestate_size())) == NULL) {
+        free(movie);
+        ERROR("Unable to allocate a movie (state size: %d)", (int) savestate_size());
+        return NULL;
+    }
+    return movie;
+}
+
+static int load_native(Movie *movie, FILE *movie_file, const char *path) {
+    Byte header[MOVIE_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), movie_file) != sizeof(header))
+        ERROR_RETURN("Movie header too short: \"%s\"", path);
+    Word version = (Word) (header[4] | (header[5] << 8));
+    if (version != MOVIE_VERSION)
+        ERROR_RETURN("Unsupported movie version %d", version);
+    movie->rom_hash = get_u64(header + 8);
+    uint32_t frame_count = get_u32(header + 16);
+    movie->checkpoint_interval = get_u32(header + 20);
+    uint32_t checkpoint_count = get_u32(header + 24);
+
+    for (uint32_t i = 0; i < frame_count; i++) {
+        Byte record[MOVIE_FRAME_SIZE];
+        if (fread(record, 1, sizeof(record), movie_file) != sizeof(record))
+            ERROR_RETURN("Movie ends at frame %u of %u: \"%s\"", i, frame_count, path);
+        Movie_frame frame = {.commands = record[0]};
+        memcpy(frame.buttons, record + 1, CONTROLLER_PORTS);
+        if (append_frame(movie, frame) < 0)
+            return -1;
+    }
+    for (uint32_t i = 0; i < checkpoint_count; i++) {
+        Byte record[MOVIE_CHECKPOINT_SIZE];
+        if (fread(record, 1, sizeof(record), movie_file) != sizeof(record))
+            ERROR_RETURN("Movie ends at checkpoint %u of %u: \"%s\"", i, checkpoint_count, path);
+        Movie_checkpoint checkpoint = {.frame = get_u32(record), .hash = get_u64(record + 4)};
+        if (append_checkpoint(movie, checkpoint) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+static int load_fm2(Movie *movie, FILE *movie_file, const char *path) {
+    /* Text header of "key value" lines, then one "|commands|port0|port1|port2|" line per frame.
+       Gamepad fields hold one character per button, '.' or ' ' when it isn't pressed */
+    char line[FM2_LINE_MAX];
+    int line_num = 0;
+    bool has_version = false;
+    while (fgets(line, sizeof(line), movie_file)) {
+        line_num++;
+        if (line[0] != '|') {
+            if (strncmp(line, "version ", 8) == 0)
+                has_version = true;
+            else if (strncmp(line, "binary 1", 8) == 0)
+                ERROR_RETURN("Binary FM2 input isn't supported: \"%s\"", path);
+            continue;
+        }
+        if (!has_version)
+            ERROR_RETURN("Neither a native nor an FM2 movie: \"%s\"", path);
+
+        Movie_frame frame = {.commands = (Byte) strtoul(line + 1, NULL, 10)};
+        char *field = strchr(line + 1, '|');
+        for (int port = 0; port < CONTROLLER_PORTS && field; port++) {
+            field++;
+            for (int i = 0; i < 8 && field[i] && field[i] != '|'; i++) {
+                if (field[i] != '.' && field[i] != ' ')
+                    frame.buttons[port] |= 0x80 >> i;
+            }
+            field = strchr(field, '|');
+        }
+        if (field == NULL)
+            ERROR_RETURN("FM2 line %d: expected \"|commands|port0|port1|port2|\"", line_num);
+        if (append_frame(movie, frame) < 0)
+            return -1;
+    }
+    if (!has_version)
+        ERROR_RETURN("Neither a native nor an FM2 movie: \"%s\"", path);
+    return 0;
+}
+
+static int append_frame(Movie *movie, Movie_frame frame) {
+    if (movie->frame_count == movie->frame_capacity) {
+        uint32_t capacity = (movie->frame_capacity) ? movie->frame_capacity * 2 : 1024;
+        Movie_frame *frames = realloc(movie->frames, capacity * sizeof(Movie_frame));
+        if (frames == NULL)
+            ERROR_RETURN("Unable to allocate %u movie frames", capacity);
+        movie->frames = frames;
+        movie->frame_capacity = capacity;
+    }
+    movie->frames[movie->frame_count++] = frame;
+    return 0;
+}
+
+static int append_checkpoint(Movie *movie, Movie_checkpoint checkpoint) {
+    if (movie->checkpoint_count == movie->checkpoint_capacity) {
+        uint32_t capacity = (movie->checkpoint_capacity) ? movie->checkpoint_capacity * 2 : 64;
+        Movie_checkpoint *checkpoints = realloc(movie->checkpoints, capacity * sizeof(Movie_checkpoint));
+        if (checkpoints == NULL)
+            ERROR_RETURN("Unable to allocate %u movie checkpoints", capacity);
+        movie->checkpoints = checkpoints;
+        movie->checkpoint_capacity = capacity;
+    }
+    movie->checkpoints[movie->checkpoint_count++] = checkpoint;
+    return 0;
+}
+
+static int check_state(Movie *movie, const Emulator *emu) {
+    // Recording takes a checkpoint every interval frames, playback compares the ones the movie has
+    if (movie->recording) {
+        if (movie->checkpoint_interval == 0 || movie->position == 0 ||
+            movie->position % movie->checkpoint_interval)
+            return 0;
+        Movie_checkpoint checkpoint = {.frame = movie->position, .hash = state_hash(movie, emu)};
+        return append_checkpoint(movie, checkpoint);
+    }
+    if (movie->next_checkpoint >= movie->checkpoint_count ||
+        movie->checkpoints[movie->next_checkpoint].frame != movie->position)
+        return 0;
+    uint64_t hash = state_hash(movie, emu);
+    uint64_t expected = movie->checkpoints[movie->next_checkpoint++].hash;
+    if (hash != expected)
+        ERROR_RETURN("Movie desync after frame %u: state hash %016llx, recorded %016llx", movie->position,
+                     (unsigned long long) hash, (unsigned long long) expected);
+    movie->verified++;
+    return 0;
+}
+
+static uint64_t state_hash(Movie *movie, const Emulator *emu) {
+    size_t size = save_state(emu, movie->state, savestate_size());
+    return fnv_hash(movie->state, size, FNV_OFFSET_BASIS);
+}
+
+static uint64_t rom_hash(const Emulator *emu) {
+    const Mapper *mapper = &emu->mapper;
+    uint64_t hash = fnv_hash(mapper->PRG_ROM_p, (size_t) mapper->PRG_ROM_banks * 0x4000, FNV_OFFSET_BASIS);
+    return fnv_hash(mapper->CHR_ROM_p, (size_t) mapper->CHR_ROM_banks * 0x2000, hash);
+}
+
+static void put_u32(Byte *out, uint32_t data) {
+    for (int i = 0; i < 4; i++)
+        out[i] = (Byte) (data >> (i * 8));
+}
+
+static void put_u64(Byte *out, uint64_t data) {
+    put_u32(out, (uint32_t) data);
+    put_u32(out + 4, (uint32_t) (data >> 32));
+}
+
+static uint32_t get_u32(const Byte *in) {
+    return in[0] | ((uint32_t) in[1] << 8) | ((uint32_t) in[2] << 16) | ((uint32_t) in[3] << 24);
+}
+
+static uint64_t get_u64(const Byte *in) {
+    return get_u32(in) | ((uint64_t) get_u32(in + 4) << 32);
+}
@@ -0,0 +1,52 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../../types.h"
+
+#define MOVIE_VERSION 1
+
+// Console commands of a frame, the same bits as the FM2 command field
+enum Movie_command {
+    MOVIE_RESET = 0x1,
+    MOVIE_POWER = 0x2
+};
+
+/* Controller input of every frame from power on, with hashes of the console state at checkpoint frames.
+   A movie is either being recorded or played back, playback stops with an error at the first checkpoint
+   whose hash differs, the frame an emulation change first diverged from the recording.
+
+   Native files are little endian: "NESM", version, reserved, the FNV-1a hash of PRG and CHR ROM,
+   frame count, checkpoint interval and count, 3 bytes per frame (commands, port 0, port 1) and
+   (frame, state hash) per checkpoint. FM2 movies are imported for their input only */
+typedef struct Movie Movie;
+
+// Empty movie recording on the cartridge of emu, checkpoints every interval frames, none for 0
+Movie *create_movie(const Emulator *emu, uint32_t checkpoint_interval);
+
+// Native or FM2 movie for playback, NULL when it can't be read
+Movie *load_movie(const char *path);
+
+int save_movie(const Movie *movie, const char *path);
+
+void destroy_movie(Movie *movie);
+
+/* Call before every frame. Recording stores the held buttons and commands, playback replaces them
+   with the recorded ones. Commands are applied to emu. Returns 1 once playback is past the last frame,
+   -1 on a desync or a movie of another cartridge */
+int movie_next_frame(Movie *movie, Emulator *emu, Byte commands);
+
+// Checks or records the state after the last frame, -1 on a desync
+int movie_finish(Movie *movie, const Emulator *emu);
+
+uint32_t movie_length(const Movie *movie);
+
+// Frames recorded or played so far
+uint32_t movie_position(const Movie *movie);
+
+// Checkpoints compared during playback
+uint32_t movie_verified(const Movie *movie);
+
+#endif // !MOVIE_H
@@ -0,0 +1,109 @@
+#include "pixels.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define USE_SSE2_PIXELS 1
+#include <emmintrin.h>
+#if defined(__GNUC__)
+#define USE_AVX2_PIXELS 1              // Compiled with a target attribute, only called once the CPU reports it
+#include <immintrin.h>
+#endif
+#endif
+
+typedef void (*Resolve_row)(const Byte *pixels, const uint32_t *colors, uint32_t *out);
+
+static void resolve_row_scalar(const Byte *pixels, const uint32_t *colors, uint32_t *out);
+
+// Host wide, the choice depends on the CPU and not on the emulator instance. Only set_pixel_pipeline()
+// changes it, draws just read it
+static Resolve_row resolve_row = resolve_row_scalar;
+static enum Pixel_pipeline current_pipeline = PIXELS_SCALAR;
+
+void resolve_pixel_row(const Byte *pixels, const uint32_t *colors, uint32_t *out) {
+    resolve_row(pixels, colors, out);
+}
+
+static void resolve_row_scalar(const Byte *pixels, const uint32_t *colors, uint32_t *out) {
+    for (int i = 0; i < 8; i++)
+        out[i] = colors[pixels[i] & 0x3];
+}
+
+#ifdef USE_SSE2_PIXELS
+static __m128i select_colors(__m128i indices, __m128i color_0, __m128i color_1, __m128i color_2, __m128i color_3) {
+    // No byte shuffle before SSSE3, each bit of the index picks between two colors with a mask instead
+    __m128i low = _mm_cmpeq_epi32(_mm_and_si128(indices, _mm_set1_epi32(1)), _mm_set1_epi32(1));
+    __m128i high = _mm_cmpgt_epi32(indices, _mm_set1_epi32(1));
+    __m128i even = _mm_or_si128(_mm_andnot_si128(high, color_0), _mm_and_si128(high, color_2));
+    __m128i odd = _mm_or_si128(_mm_andnot_si128(high, color_1), _mm_and_si128(high, color_3));
+    return _mm_or_si128(_mm_andnot_si128(low, even), _mm_and_si128(low, odd));
+}
+
+static void resolve_row_sse2(const Byte *pixels, const uint32_t *colors, uint32_t *out) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i indices = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) pixels), zero);
+    __m128i color_0 = _mm_set1_epi32((int) colors[0]), color_1 = _mm_set1_epi32((int) colors[1]);
+    __m128i color_2 = _mm_set1_epi32((int) colors[2]), color_3 = _mm_set1_epi32((int) colors[3]);
+    _mm_storeu_si128((__m128i *) out,
+                     select_colors(_mm_unpacklo_epi16(indices, zero), color_0, color_1, color_2, color_3));
+    _mm_storeu_si128((__m128i *) (out + 4),
+                     select_colors(_mm_unpackhi_epi16(indices, zero), color_0, color_1, color_2, color_3));
+}
+#endif
+
+#ifdef USE_AVX2_PIXELS
+__attribute__((target("avx2")))
+static void resolve_row_avx2(const Byte *pixels, const uint32_t *colors, uint32_t *out) {
+    // The 4 colors sit in both 128 bit lanes, one permute looks up all 8 pixels
+    __m256i table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) colors));
+    __m256i indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *) pixels));
+    _mm256_storeu_si256((__m256i *) out, _mm256_permutevar8x32_epi32(table, indices));
+}
+#endif
+
+static bool pipeline_supported(enum Pixel_pipeline pipeline) {
+    switch (pipeline) {
+        case PIXELS_SCALAR: return true;
+#ifdef USE_SSE2_PIXELS
+        case PIXELS_SSE2: return true;
+#endif
+#ifdef USE_AVX2_PIXELS
+        case PIXELS_AVX2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+        default: return false;
+    }
+}
+
+bool set_pixel_pipeline(enum Pixel_pipeline pipeline) {
+    if (pipeline == PIXELS_AUTO) {
+        pipeline = PIXELS_AVX2;
+        while (!pipeline_supported(pipeline))
+            pipeline--;
+    }
+    if (!pipeline_supported(pipeline))
+        return false;
+    switch (pipeline) {
+#ifdef USE_AVX2_PIXELS
+        case PIXELS_AVX2: resolve_row = resolve_row_avx2; break;
+#endif
+#ifdef USE_SSE2_PIXELS
+        case PIXELS_SSE2: resolve_row = resolve_row_sse2; break;
+#endif
+        default: resolve_row = resolve_row_scalar; break;
+    }
+    current_pipeline = pipeline;
+    return true;
+}
+
+enum Pixel_pipeline get_pixel_pipeline(void) {
+    return current_pipeline;
+}
+
+const char *pixel_pipeline_name(enum Pixel_pipeline pipeline) {
+    switch (pipeline) {
+        case PIXELS_SCALAR: return "scalar";
+        case PIXELS_SSE2: return "SSE2";
+        case PIXELS_AVX2: return "AVX2";
+        default: return "auto";
+    }
+}
@@ -0,0 +1,28 @@
+#ifndef PIXELS_H
+#define PIXELS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../../types.h"
+
+/* Turns rows of 8 palette indices into screen colors. The scalar implementation runs everywhere and is
+   used until set_pixel_pipeline() picks another one, which has to happen before any emulator thread starts */
+enum Pixel_pipeline {
+    PIXELS_AUTO,                        // Best one the host supports
+    PIXELS_SCALAR,
+    PIXELS_SSE2,                        // Any x86-64 host
+    PIXELS_AVX2
+};
+
+// false when the host can't run pipeline, the current one is kept. Not thread safe, draws read the choice
+bool set_pixel_pipeline(enum Pixel_pipeline pipeline);
+
+enum Pixel_pipeline get_pixel_pipeline(void);
+
+const char *pixel_pipeline_name(enum Pixel_pipeline pipeline);
+
+// out[i] = colors[pixels[i]] for the 8 pixels of a tile row, pixels are 0 - 3
+void resolve_pixel_row(const Byte *pixels, const uint32_t *colors, uint32_t *out);
+
+#endif // !PIXELS_H
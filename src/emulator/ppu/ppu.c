@@ -1,39 +1,118 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-#include "../global.h"
+#include "pixels.h"
+#include "../emulator.h"
 #include "../../utils.h"
 
-static void ppu_draw(void);
-static Pattern_row get_pattern_row(Byte table_index, Byte plane_num, Byte plane_y);
-static uint32_t get_pixel_color(Byte palette_num, Byte pixel);
-static void draw_pixel_row(Pattern_row pattern_row, uint32_t *buffer, Byte palette_num, int row_x, int y);
-static void update_vram_address(void);
-
-void ppu_clock(void) {
-    if (p_ppu->dots >= DOTS) {
-        p_ppu->scanlines++;
-        if (p_ppu->scanlines >= SCANLINES) {
-            p_ppu->scanlines = -1;
-            p_ppu->frame_complete = true;
-            SDL_UpdateTexture(p_ppu->ppu_draw_texture, NULL, p_ppu->screen_buffer, NES_WIDTH * 4);
+#define VBLANK_POSITION ((241 + 1) * DOTS + 1)      // Scanline 241 dot 1, counted from the pre-render line
+#define FRAME_END_POSITION ((SCANLINES + 1) * DOTS)
+#define SKIPPED_DOT_POSITION 339
+
+static void draw_background(Emulator *emu, int end_x);
+static void decode_tile(Emulator *emu, Word tile);
+static void resolve_palette(Emulator *emu);
+static void update_vram_address(PPU *ppu);
+static int skipped_dots(const PPU *ppu, bool odd_frame, int position, int target);
+
+void ppu_clock(Emulator *emu) {
+    PPU *ppu = &emu->ppu;
+    if (ppu->dots >= DOTS) {
+        ppu->scanlines++;
+        if (ppu->scanlines >= SCANLINES) {
+            ppu->scanlines = -1;
+            ppu->frame_complete = true;
+            ppu->odd_frame = !ppu->odd_frame;
+            if (ppu->ppu_draw_texture && !ppu->skip_draw)    // No texture when running headless
+                SDL_UpdateTexture(ppu->ppu_draw_texture, NULL, ppu->screen_buffer, NES_WIDTH * 4);
         }
-        p_ppu->dots = 0;
+        ppu->dots = 0;
+        ppu->drawn_x = 0;
     }
 
-    if (p_ppu->dots > -1 && p_ppu->dots < NES_WIDTH && p_ppu->scanlines > -1 && p_ppu->scanlines < NES_HEIGHT) 
-        ppu_draw();
+    // Visible lines are drawn in one pass once their last pixel is due, flush_scanline() draws the part before
+    // a mid-line write first. Drawing only reads VRAM and CHR, NROM has nothing that reacts to the fetches so
+    // hidden frames skip them
+    if (ppu->dots == NES_WIDTH && !ppu->skip_draw && ppu->scanlines > -1 && ppu->scanlines < NES_HEIGHT)
+        draw_background(emu, NES_WIDTH);
 
-    if (p_ppu->PPUMASK.Render_background || p_ppu->PPUMASK.Render_sprites) update_vram_address();
+    // The address only moves on the lines that fetch tiles, the pre-render line and the visible ones
+    if ((ppu->PPUMASK.Render_background || ppu->PPUMASK.Render_sprites) && ppu->scanlines < NES_HEIGHT)
+        update_vram_address(ppu);
 
-    if (p_ppu->scanlines == -1 && p_ppu->dots == 1) {
-        p_ppu->PPUSTATUS.Verticle_blank = 0;
+    if (ppu->scanlines == -1 && ppu->dots == 1) {
+        ppu->PPUSTATUS.Verticle_blank = 0;
     }
-    if (p_ppu->scanlines == 241 && p_ppu->dots == 1) {
-        p_ppu->PPUSTATUS.Verticle_blank = 1;
-        p_ppu->create_nmi = true;
+    if (ppu->scanlines == 241 && ppu->dots == 1) {
+        ppu->PPUSTATUS.Verticle_blank = 1;
+        ppu->create_nmi = true;
     }
-    p_ppu->dots++;
+    ppu->dots++;
+    // Odd frames skip the last dot of the pre-render scanline while rendering
+    if (ppu->scanlines == -1 && ppu->dots == 340 && ppu->odd_frame &&
+        (ppu->PPUMASK.Render_background || ppu->PPUMASK.Render_sprites))
+        ppu->dots++;
+}
+
+void ppu_run(Emulator *emu, int dots) {
+    for (int i = 0; i < dots; i++) ppu_clock(emu);
+}
+
+void sync_ppu(Emulator *emu) {
+    PPU *ppu = &emu->ppu;
+    int64_t debt = emu->cycles - ppu->synced_cycles;
+    PROFILE_BEGIN(start);
+    if (debt > 0) ppu_run(emu, (int) debt * 3);
+    PROFILE_END(start, emu->profile.ppu_ticks);
+    ppu->synced_cycles = emu->cycles;
+}
+
+void map_nametables(Emulator *emu) {
+    // VRAM table behind each slot, the same two tables whatever the mirroring so switching it keeps them
+    static const Byte layouts[][4] = {
+        [HORIZONTAL] = {0, 0, 1, 1},
+        [VERTICAL] = {0, 1, 0, 1},
+        [SINGLE_SCREEN_LOW] = {0, 0, 0, 0},
+        [SINGLE_SCREEN_HIGH] = {1, 1, 1, 1},
+        [FOUR_SCREEN] = {0, 1, 2, 3}
+    };
+    PPU *ppu = &emu->ppu;
+    for (int slot = 0; slot < 4; slot++)
+        ppu->nametable_slots[slot] = ppu->Bus.Nametable[layouts[emu->mapper.mirroring][slot]];
+}
+
+void schedule_ppu_events(Emulator *emu) {
+    PPU *ppu = &emu->ppu;
+    // Exact number of ppu_clock() calls (counting the current one) until vblank is set and
+    // until the frame completes, converted to the CPU cycle the call falls in
+    int position = (ppu->scanlines + 1) * DOTS + ppu->dots;
+    int vblank_dots, frame_dots;
+
+    frame_dots = FRAME_END_POSITION - position + 1 - skipped_dots(ppu, ppu->odd_frame, position, FRAME_END_POSITION);
+    if (position <= VBLANK_POSITION)
+        vblank_dots = VBLANK_POSITION - position + 1 - skipped_dots(ppu, ppu->odd_frame, position, VBLANK_POSITION);
+    else
+        vblank_dots = frame_dots + VBLANK_POSITION - skipped_dots(ppu, !ppu->odd_frame, 0, VBLANK_POSITION);
+
+    schedule_event(emu, EVENT_PPU_VBLANK, ppu->synced_cycles + (vblank_dots + 2) / 3, ppu_vblank_event);
+    schedule_event(emu, EVENT_PPU_FRAME, ppu->synced_cycles + (frame_dots + 2) / 3, ppu_frame_event);
+}
+
+static int skipped_dots(const PPU *ppu, bool odd_frame, int position, int target) {
+    bool rendering = ppu->PPUMASK.Render_background || ppu->PPUMASK.Render_sprites;
+    return (odd_frame && rendering && position <= SKIPPED_DOT_POSITION && target > SKIPPED_DOT_POSITION) ? 1 : 0;
+}
+
+void ppu_vblank_event(Emulator *emu) {
+    sync_ppu(emu);
+    if (emu->ppu.create_nmi && emu->ppu.PPUCTRL.Generate_NMI) request_nmi(emu);
+    schedule_ppu_events(emu);
+}
+
+void ppu_frame_event(Emulator *emu) {
+    sync_ppu(emu);
+    schedule_ppu_events(emu);
 }
 
 uint32_t NES_Palette[64] = {
@@ -43,27 +122,66 @@ uint32_t NES_Palette[64] = {
     0xFEFFFF, 0xBED6FD, 0xCCCCFF, 0xDDC4FF, 0xEAC0F9, 0xF2C1DF, 0xF1C7C2, 0xE8D0AA, 0xD9DA9D, 0xC9E29E, 0xBCE6AE, 0xB4E5C7, 0xB5DFE4, 0xA9A9A9, 0x000000, 0x000000
 };
 
-static void ppu_draw(void) {
-    // if (-1 < p_ppu->dots && p_ppu->dots < DOTS && -1 < p_ppu->scanlines && p_ppu->scanlines < SCANLINES) {
-    //     p_ppu->screen_buffer[p_ppu->scanlines * DOTS + p_ppu->dots] = (rand() % 2) ? 0x00FFFFFF : 0x000000FF;
-    // 
-
-    // TODO fill the function
-
-    // DEBUG
-    // if (p_ppu->dots && ((p_ppu->dots/* + p_ppu->fine_x*/) % 8)) return;
-    if (p_ppu->dots % 8) return;
-    /* if (p_ppu->PPUMASK.Render_background) { */
-        Byte Plane_num = ppu_read_byte((((Word) p_ppu->scanlines / 8) << 5) | ((Word) p_ppu->dots / 8) | 0x2000);
-        // Byte Plane_num = ppu_read_byte((p_ppu->current_address._ & 0xFFF) | 0x2000);
-        Pattern_row pattern = get_pattern_row(p_ppu->PPUCTRL.Background_pattern_address, Plane_num, (Byte) (p_ppu->scanlines % 8));
-        draw_pixel_row(pattern, p_ppu->screen_buffer, 0, p_ppu->dots, p_ppu->scanlines);
-        // p_ppu->dots += 7;
-    /* } */
+int scanline_due_x(const PPU *ppu) {
+    // Tiles start on every 8th pixel of the scrolled line, shifted left by fine_x. The ones whose first dot
+    // has passed are due
+    if (ppu->dots >= NES_WIDTH)
+        return NES_WIDTH;
+    int end_x = ((ppu->dots + ppu->fine_x + 7) & ~7) - ppu->fine_x;
+    return (end_x < 0) ? 0 : (end_x > NES_WIDTH) ? NES_WIDTH : end_x;
+}
+
+void flush_scanline(Emulator *emu) {
+    PPU *ppu = &emu->ppu;
+    if (ppu->skip_draw || ppu->scanlines < 0 || ppu->scanlines >= NES_HEIGHT)
+        return;
+    draw_background(emu, scanline_due_x(ppu));
 }
 
-void reset_ppu(void) {
-    *p_ppu = (PPU) {
+static void draw_background(Emulator *emu, int end_x) {
+    PPU *ppu = &emu->ppu;
+    if (end_x <= ppu->drawn_x)
+        return;
+    if (!ppu->palette_valid)
+        resolve_palette(emu);
+    uint32_t *line = &ppu->screen_buffer[ppu->scanlines * NES_WIDTH];
+    if (!ppu->PPUMASK.Render_background) {
+        for (int x = ppu->drawn_x; x < end_x; x++)
+            line[x] = ppu->palette_colors[0];
+        ppu->drawn_x = end_x;
+        return;
+    }
+
+    /* current_address has moved past the two tiles fetched at the end of the previous line and one more
+       every 8 dots since, step back to the tile of pixel 0. Coarse X and the horizontal nametable select
+       count on together, 64 tiles across the two tables */
+    const VRAM_ADDR_reg address = ppu->current_address;
+    int fetched = 2 + ((ppu->dots > 0) ? (ppu->dots - 1) / 8 : 0);
+    int line_x = (address.nametable_select_x << 5 | address.coarse_x) - fetched;
+    Word row = 0x2000 | (Word) (address.nametable_select_y << 11) | (Word) (address.coarse_y << 5);
+    Word table = (ppu->PPUCTRL.Background_pattern_address) ? 0x100 : 0x000;
+    for (int x = ppu->drawn_x; x < end_x;) {
+        int scrolled_x = x + ppu->fine_x;
+        int column = (line_x + scrolled_x / 8) & 0x3F;
+        Byte Plane_num = ppu_read_byte(emu, row | (Word) ((column & 0x20) << 5) | (Word) (column & 0x1F));
+        const Byte *pixels = get_tile_row(emu, table | Plane_num, (Byte) address.fine_y);
+        int first = scrolled_x % 8;
+        int count = (end_x - x < 8 - first) ? end_x - x : 8 - first;
+        if (count == 8)
+            draw_pixel_row(emu, pixels, ppu->screen_buffer, 0, x, ppu->scanlines);
+        else {
+            // Line edges with fine_x, and the tile a mid-line write split
+            for (int i = 0; i < count; i++)
+                line[x + i] = ppu->palette_colors[pixels[first + i]];
+        }
+        x += count;
+    }
+    ppu->drawn_x = end_x;
+}
+
+void reset_ppu(Emulator *emu) {
+    PPU *ppu = &emu->ppu;
+    *ppu = (PPU) {
         .PPUCTRL._ =  0, .PPUMASK._ =  0,   // ALL registers initialized with 0
         .PPUSTATUS._ =  0,
         .current_address._ = 0, .temp_address._ = 0, .fine_x = 0,
@@ -72,17 +190,20 @@ void reset_ppu(void) {
         .VRAM_increment = 1,            // Default VRAM address increment to 1
         .dots = 0, .scanlines = -1,      // Number of dots and scanlines to 0
         .frame_complete = false,        // Frame complete to false
+        .odd_frame = false,
+        .synced_cycles = 0,
         .create_nmi = false
     };
 
-    memset(p_ppu->screen_buffer, 0, NES_WIDTH * NES_HEIGHT * sizeof(*p_ppu->screen_buffer));
-    memset(p_ppu->Bus.Palettes, 0, 0x1F);
+    memset(ppu->screen_buffer, 0, NES_WIDTH * NES_HEIGHT * sizeof(*ppu->screen_buffer));
+    memset(ppu->Bus.Palettes, 0, 0x1F);
     for (int i = 0; i < 4; i++)
-        memset(p_ppu->Bus.Nametable[i], 0, 1024);
-    p_ppu->PPUSTATUS.Verticle_blank = 1;
+        memset(ppu->Bus.Nametable[i], 0, 1024);
+    ppu->PPUSTATUS.Verticle_blank = 1;
 }
 
-int init_ppu(SDL_Renderer *renderer) {
+int init_ppu(Emulator *emu, SDL_Renderer *renderer) {
+    PPU *ppu = &emu->ppu;
     int pixel_format = SDL_PIXELFORMAT_RGB888;
     SDL_Texture *texture = SDL_CreateTexture(renderer,
                                              pixel_format,
@@ -90,9 +211,9 @@ int init_ppu(SDL_Renderer *renderer) {
                                              NES_WIDTH, NES_HEIGHT);
     if (texture == NULL)
         ERROR_RETURN("Unable to create NES screen texture\n    SDL error: %s", SDL_GetError());
-    p_ppu->ppu_draw_texture = texture;
+    ppu->ppu_draw_texture = texture;
 
-    int status = SDL_SetRenderTarget(renderer, p_ppu->ppu_draw_texture);
+    int status = SDL_SetRenderTarget(renderer, ppu->ppu_draw_texture);
     status = SDL_SetRenderDrawColor(renderer, 255, 255, 0, 255);
     status = SDL_RenderClear(renderer);
     status = SDL_SetRenderTarget(renderer, NULL);
@@ -103,7 +224,8 @@ int init_ppu(SDL_Renderer *renderer) {
     return 0;
 }
 
-Byte cpu_to_ppu_read(Word address) {
+Byte cpu_to_ppu_read(Emulator *emu, Word address) {
+    PPU *ppu = &emu->ppu;
     address &= 0x0007;
     Byte data = 0;
     switch (address) {
@@ -114,10 +236,10 @@ Byte cpu_to_ppu_read(Word address) {
         break;
 
         case 0x2: //PPUSTATUS *** READ only ***
-            p_ppu->PPUSTATUS.PPU_open_bus = p_ppu->PPUDATA & 0x1F;
-            data = p_ppu->PPUSTATUS._;
-            p_ppu->PPUSTATUS.Verticle_blank = 0;
-            p_ppu->write_latch = 0;
+            ppu->PPUSTATUS.PPU_open_bus = ppu->PPUDATA & 0x1F;
+            data = ppu->PPUSTATUS._;
+            ppu->PPUSTATUS.Verticle_blank = 0;
+            ppu->write_latch = 0;
         break;
 
         case 0x3: //OAMADDR *** WRITE only ***
@@ -133,27 +255,31 @@ Byte cpu_to_ppu_read(Word address) {
         break;
 
         case 0x7: //PPUDATA *** READ / WRITE ***
-            data = (Byte) p_ppu->PPUDATA;
-            p_ppu->PPUDATA = ppu_read_byte(p_ppu->current_address._);
-            if (p_ppu->current_address._ >= 0x3F00) data = p_ppu->PPUDATA;
-            p_ppu->current_address._ += p_ppu->VRAM_increment;
+            data = (Byte) ppu->PPUDATA;
+            ppu->PPUDATA = ppu_read_byte(emu, ppu->current_address._);
+            if (ppu->current_address._ >= 0x3F00) data = ppu->PPUDATA;
+            ppu->current_address._ += ppu->VRAM_increment;
         break;
     }
     return data;
 }
 
-Byte cpu_to_ppu_write(Word address, Byte data) {
+Byte cpu_to_ppu_write(Emulator *emu, Word address, Byte data) {
+    PPU *ppu = &emu->ppu;
+    flush_scanline(emu);            // What was fetched before the write keeps the old registers and VRAM
     address &= 0x0007;
     switch (address) {
         case 0x0: //PPUCTRL *** WRITE only ***
-            p_ppu->PPUCTRL._ = data;
-            p_ppu->VRAM_increment = (p_ppu->PPUCTRL.VRAM_address_inc) ? 32 : 1;
-            p_ppu->temp_address.nametable_select_x = p_ppu->PPUCTRL.Nametable_select_x;
-            p_ppu->temp_address.nametable_select_y = p_ppu->PPUCTRL.Nametable_select_y;
+            ppu->PPUCTRL._ = data;
+            ppu->VRAM_increment = (ppu->PPUCTRL.VRAM_address_inc) ? 32 : 1;
+            ppu->temp_address.nametable_select_x = ppu->PPUCTRL.Nametable_select_x;
+            ppu->temp_address.nametable_select_y = ppu->PPUCTRL.Nametable_select_y;
+            if (ppu->create_nmi && ppu->PPUCTRL.Generate_NMI) request_nmi(emu);
         break;
 
         case 0x1: //PPUMASK *** WRITE only ***
-            p_ppu->PPUMASK._ = data;
+            ppu->PPUMASK._ = data;
+            schedule_ppu_events(emu);   // Rendering decides the odd frame skip
         break;
 
         case 0x2: //PPUSTATUS *** READ only ***
@@ -166,161 +292,170 @@ Byte cpu_to_ppu_write(Word address, Byte data) {
         break;
 
         case 0x5: //PPUSCROLL *** WRITE only ***
-            if (!p_ppu->write_latch) {
-                p_ppu->temp_address.coarse_x = data >> 3;
-                p_ppu->fine_x = data & 0x7;
-                p_ppu->write_latch = 1;
+            if (!ppu->write_latch) {
+                ppu->temp_address.coarse_x = data >> 3;
+                ppu->fine_x = data & 0x7;
+                ppu->write_latch = 1;
             }
             else {
-                p_ppu->temp_address.coarse_y = data >> 3;
-                p_ppu->temp_address.fine_y = data & 0x7;
-                p_ppu->write_latch = 0;
+                ppu->temp_address.coarse_y = data >> 3;
+                ppu->temp_address.fine_y = data & 0x7;
+                ppu->write_latch = 0;
             }
         break;
 
         case 0x6: //PPUADDR *** WRITE only ***
-            if (!p_ppu->write_latch) {
-                p_ppu->temp_address._ = (p_ppu->temp_address._ & 0x00FF) | (((Word) data & 0x3F) << 8);
-                p_ppu->write_latch = 1;
+            if (!ppu->write_latch) {
+                ppu->temp_address._ = (ppu->temp_address._ & 0x00FF) | (((Word) data & 0x3F) << 8);
+                ppu->write_latch = 1;
             }
             else {
-                p_ppu->temp_address._ = (p_ppu->temp_address._ & 0xFF00) | (Word) data;
-                p_ppu->current_address._ = p_ppu->temp_address._;
-                p_ppu->write_latch = 0;
+                ppu->temp_address._ = (ppu->temp_address._ & 0xFF00) | (Word) data;
+                ppu->current_address._ = ppu->temp_address._;
+                ppu->write_latch = 0;
             }
         break;
 
         case 0x7: //PPUDATA *** READ / WRITE ***
-            p_ppu->PPUDATA = data;
-            ppu_write_byte(p_ppu->current_address._, data);
-            p_ppu->current_address._ += p_ppu->VRAM_increment;
+            ppu->PPUDATA = data;
+            ppu_write_byte(emu, ppu->current_address._, data);
+            ppu->current_address._ += ppu->VRAM_increment;
         break;
     }
     return 0;
 }
 
-Byte ppu_read_byte(Word address) {
+Byte ppu_read_byte(Emulator *emu, Word address) {
+    PPU *ppu = &emu->ppu;
     Byte data = 0x00;
     address &= 0x3FFF;
     // Inside CHR_ROM or pattern tables
     if (address <= 0x1FFF)
-        data = p_mapper->ppu_read(p_mapper, address);
+        data = emu->mapper.ppu_read(&emu->mapper, address);
         // Inside Nametable memory
-    else if (0x2000 <= address && address <= 0x2FFF) {
-        Byte table_index = (address >> 10) & 0x3;
-        address &= 0x3FF;
-        //Mirroring
-        if (p_mapper->mirroring == HORIZONTAL)
-            table_index = (table_index & 0x2) ? 2 : 0;
-        else
-            table_index = (table_index & 0x1) ? 1 : 0;
-
-        data = p_ppu->Bus.Nametable[table_index][address];
-    } // Inside Palette memory
+    else if (0x2000 <= address && address <= 0x2FFF)
+        data = ppu->nametable_slots[(address >> 10) & 0x3][address & 0x3FF];
+        // Inside Palette memory
     else if (0x3F00 <= address && address <= 0x3FFF) {
         address &= 0x1F;
         address = (address == 0x10) ? 0x00 : address;
         address = (address == 0x14) ? 0x04 : address;
         address = (address == 0x18) ? 0x08 : address;
         address = (address == 0x1C) ? 0x0C : address;
-        data = p_ppu->Bus.Palettes[address];
+        data = ppu->Bus.Palettes[address];
     }
 
     return data;
 }
 
-Byte ppu_write_byte(Word address, Byte data) {
+Byte ppu_write_byte(Emulator *emu, Word address, Byte data) {
+    PPU *ppu = &emu->ppu;
     address &= 0x3FFF;
     // Inside CHR_ROM or pattern tables
-    if (address <= 0x1FFF)
-        p_mapper->ppu_write(p_mapper, address, data);
-        // Inside Nametable memory
-    else if (0x2000 <= address && address <= 0x2FFF) {
-        Byte table_index = (address >> 10) & 0x3;
-        address &= 0x3FF;
-        //Mirroring
-        if (p_mapper->mirroring == HORIZONTAL)
-            table_index = (table_index & 0x2) ? 2 : 0;
-        else
-            table_index = (table_index & 0x1) ? 1 : 0;
-
-        p_ppu->Bus.Nametable[table_index][address] = data;
-    } // Inside Palette memory
+    if (address <= 0x1FFF) {
+        emu->mapper.ppu_write(&emu->mapper, address, data);
+        invalidate_tiles(emu, address, 1);
+    } // Inside Nametable memory
+    else if (0x2000 <= address && address <= 0x2FFF)
+        ppu->nametable_slots[(address >> 10) & 0x3][address & 0x3FF] = data;
+        // Inside Palette memory
     else if (0x3F00 <= address && address <= 0x3FFF) {
         address &= 0x1F;
         address = (address == 0x10) ? 0x00 : address;
         address = (address == 0x14) ? 0x04 : address;
         address = (address == 0x18) ? 0x08 : address;
         address = (address == 0x1C) ? 0x0C : address;
-        p_ppu->Bus.Palettes[address] = data;
+        ppu->Bus.Palettes[address] = data;
+        ppu->palette_valid = false;
     }
 
     return 0;
 }
 
-static Pattern_row get_pattern_row(Byte table_index, Byte plane_num, Byte plane_y) {
-    Word address = (table_index) ? 0x1000 : 0x0000;
-    address |= ((Word) plane_num) << 4;
-    address |= (plane_y < 8) ? plane_y : 0;
-    return (Pattern_row) {
-        .LS_Byte = ppu_read_byte(address),
-        .MS_Byte = ppu_read_byte(address | 0x8)
-    };
+const Byte *get_tile_row(Emulator *emu, Word tile, Byte fine_y) {
+    PPU *ppu = &emu->ppu;
+    if (!ppu->tile_valid[tile])
+        decode_tile(emu, tile);
+    return ppu->tile_pixels[tile][fine_y & 0x7];
+}
+
+static void decode_tile(Emulator *emu, Word tile) {
+    PPU *ppu = &emu->ppu;
+    Word address = tile << 4;
+    for (int y = 0; y < 8; y++) {
+        Byte low = ppu_read_byte(emu, address | y);
+        Byte high = ppu_read_byte(emu, address | 0x8 | y);
+        // Bit 7 is the leftmost pixel
+        for (int x = 0; x < 8; x++)
+            ppu->tile_pixels[tile][y][x] = ((low >> (7 - x)) & 0x1) | (((high >> (7 - x)) & 0x1) << 1);
+    }
+    ppu->tile_valid[tile] = true;
+}
+
+void invalidate_tiles(Emulator *emu, Word address, int size) {
+    PPU *ppu = &emu->ppu;
+    for (int tile = address >> 4; tile < (address + size + 15) >> 4 && tile < TILE_COUNT; tile++)
+        ppu->tile_valid[tile] = false;
 }
 
-static uint32_t get_pixel_color(Byte palette_num, Byte pixel) {
-    Byte pixel_index = ppu_read_byte((palette_num << 2) + pixel + 0x3F00);
-    return NES_Palette[pixel_index & 0x3F];
+static void resolve_palette(Emulator *emu) {
+    PPU *ppu = &emu->ppu;
+    for (int i = 0; i < 32; i++)
+        ppu->palette_colors[i] = NES_Palette[ppu_read_byte(emu, 0x3F00 | i) & 0x3F];
+    ppu->palette_valid = true;
 }
 
-static void draw_pixel_row(Pattern_row pattern_row, uint32_t *buffer, Byte palette_num, int row_x, int y) {
-    for (int i = 7; i > -1; i--) {
-        Byte low_bit = pattern_row.LS_Byte & 0x1;
-        Byte high_bit = (pattern_row.MS_Byte & 0x1) << 1;
-        uint32_t pixel_color = get_pixel_color(palette_num, high_bit | low_bit);
+void draw_pixel_row(Emulator *emu, const Byte *pixels, uint32_t *buffer, Byte palette_num, int row_x, int y) {
+    PPU *ppu = &emu->ppu;
+    if (!ppu->palette_valid)
+        resolve_palette(emu);
+    const uint32_t *colors = &ppu->palette_colors[(palette_num & 0x7) * COLORS_PER_PALETTE];
+    if (row_x > -1 && row_x <= NES_WIDTH - 8) {
+        resolve_pixel_row(pixels, colors, &buffer[(y * NES_WIDTH) + row_x]);
+        return;
+    }
+    for (int i = 0; i < 8; i++) {
         if ((row_x + i) > -1 && (row_x + i) < 256)
-            buffer[(y * NES_WIDTH) + row_x + i] = pixel_color;
-        pattern_row.LS_Byte >>= 1;
-        pattern_row.MS_Byte >>= 1;
+            buffer[(y * NES_WIDTH) + row_x + i] = colors[pixels[i]];
     }
 }
 
-static void update_vram_address(void) {
-    if (p_ppu->dots == 256) {
-        if (p_ppu->current_address.fine_y == 7) {
-            if (p_ppu->current_address.coarse_y == 29) {
-                p_ppu->current_address.coarse_y = 0;
-                p_ppu->current_address.nametable_select_y = ~p_ppu->current_address.nametable_select_y;
+static void update_vram_address(PPU *ppu) {
+    if (ppu->dots == 256) {
+        if (ppu->current_address.fine_y == 7) {
+            if (ppu->current_address.coarse_y == 29) {
+                ppu->current_address.coarse_y = 0;
+                ppu->current_address.nametable_select_y = ~ppu->current_address.nametable_select_y;
             }
-            else if (p_ppu->current_address.coarse_y == 31) {
-                p_ppu->current_address.coarse_y = 0;
+            else if (ppu->current_address.coarse_y == 31) {
+                ppu->current_address.coarse_y = 0;
             }
             else {
-                p_ppu->current_address.coarse_y++;
+                ppu->current_address.coarse_y++;
             }
-            p_ppu->current_address.fine_y = 0;
+            ppu->current_address.fine_y = 0;
         }
         else {
-            p_ppu->current_address.fine_y++;
+            ppu->current_address.fine_y++;
         }
     }
-    if (p_ppu->dots == 257) {
-        p_ppu->current_address.nametable_select_x = p_ppu->temp_address.nametable_select_x;
-        p_ppu->current_address.coarse_x = p_ppu->temp_address.coarse_x;
+    if (ppu->dots == 257) {
+        ppu->current_address.nametable_select_x = ppu->temp_address.nametable_select_x;
+        ppu->current_address.coarse_x = ppu->temp_address.coarse_x;
     }
-    if (p_ppu->dots > 279 && p_ppu->dots < 305) {
-        p_ppu->current_address.fine_y = p_ppu->temp_address.fine_y;
-        p_ppu->current_address.nametable_select_y = p_ppu->temp_address.nametable_select_y;
-        p_ppu->current_address.coarse_y = p_ppu->temp_address.coarse_y;
+    if (ppu->scanlines == -1 && ppu->dots > 279 && ppu->dots < 305) {
+        ppu->current_address.fine_y = ppu->temp_address.fine_y;
+        ppu->current_address.nametable_select_y = ppu->temp_address.nametable_select_y;
+        ppu->current_address.coarse_y = ppu->temp_address.coarse_y;
     }
-    if (p_ppu->dots > 327 || p_ppu->dots < 257) {
-        if (p_ppu->dots && !(p_ppu->dots % 8)) {
-            if (p_ppu->current_address.coarse_x == 31) {
-                p_ppu->current_address.coarse_x = 0;
-                p_ppu->current_address.nametable_select_x = ~p_ppu->current_address.nametable_select_x;
+    if (ppu->dots > 327 || ppu->dots < 257) {
+        if (ppu->dots && !(ppu->dots % 8)) {
+            if (ppu->current_address.coarse_x == 31) {
+                ppu->current_address.coarse_x = 0;
+                ppu->current_address.nametable_select_x = ~ppu->current_address.nametable_select_x;
             }
             else {
-                p_ppu->current_address.coarse_x++;
+                ppu->current_address.coarse_x++;
             }
         }
     }
@@ -15,9 +15,11 @@
 #define DOTS 341
 #define SCANLINES 261
 
+#define TILE_COUNT 512              // Both pattern tables, $0000 - $1FFF
+
 
 typedef struct {
-    Byte Nametable[4][1024];// 4KB for 4 nametables ->		$2000 - $2FFF
+    Byte Nametable[4][1024];// 4KB for 4 nametables ->		$2000 - $2FFF, 0 and 1 are the console VRAM
     Byte Palettes[32];		// 32B for palettes ->			$3F00 - $3FFF
 } PPU_Bus;
 
@@ -34,33 +36,69 @@ typedef struct {
     Byte write_latch;
     // Bus
     PPU_Bus Bus;
+    Byte *nametable_slots[4];   // Table behind $2000 / $2400 / $2800 / $2C00, see map_nametables()
     // Helper members
     Byte VRAM_increment;
     int dots;
     int scanlines;
+    int drawn_x;                // Pixels of the current line in screen_buffer, visible lines are drawn lazily
     uint32_t screen_buffer[NES_WIDTH * NES_HEIGHT];
     SDL_Texture *ppu_draw_texture;
     bool frame_complete;
+    bool odd_frame;
+    int64_t synced_cycles;      // CPU cycle the PPU has been clocked up to
     bool create_nmi;
+    bool skip_draw;             // Frames emulated for run-ahead update the state but not the screen buffer
+    // Pattern tables with the two bitplanes merged into one palette index (0 - 3) per pixel. A tile is
+    // decoded the first time it is drawn and again after invalidate_tiles()
+    Byte tile_pixels[TILE_COUNT][8][8];
+    bool tile_valid[TILE_COUNT];
+    // Screen colors of the 32 palette RAM entries, mirrors included. Built before the next draw after a
+    // palette write, a savestate load or a reset
+    uint32_t palette_colors[32];
+    bool palette_valid;
 } PPU;
 
-typedef struct {
-    Byte LS_Byte;
-    Byte MS_Byte;
-} Pattern_row;
+void reset_ppu(Emulator *emu);
+
+int init_ppu(Emulator *emu, SDL_Renderer *renderer);
+
+void ppu_clock(Emulator *emu);
+
+void ppu_run(Emulator *emu, int dots);
+
+void sync_ppu(Emulator *emu);
+
+// Points the nametable slots at VRAM for the mapper's mirroring, again whenever it changes
+void map_nametables(Emulator *emu);
+
+// Pixels of the current line due by the current dot, the rest of the line is drawn later
+int scanline_due_x(const PPU *ppu);
+
+// Draws the part of the current line that is due, before a write changes what the rest of it fetches
+void flush_scanline(Emulator *emu);
+
+void schedule_ppu_events(Emulator *emu);
+
+// Scheduler callbacks of EVENT_PPU_VBLANK and EVENT_PPU_FRAME
+void ppu_vblank_event(Emulator *emu);
+
+void ppu_frame_event(Emulator *emu);
 
-void reset_ppu(void);
+Byte ppu_read_byte(Emulator *emu, Word address);
 
-int init_ppu(SDL_Renderer *renderer);
+Byte ppu_write_byte(Emulator *emu, Word address, Byte data);
 
-void ppu_clock(void);
+// Background renderer steps, exported for the microbenchmarks. Tiles 256 - 511 are the $1000 table
+const Byte *get_tile_row(Emulator *emu, Word tile, Byte fine_y);
 
-Byte ppu_read_byte(Word address);
+void draw_pixel_row(Emulator *emu, const Byte *pixels, uint32_t *buffer, Byte palette_num, int row_x, int y);
 
-Byte ppu_write_byte(Word address, Byte data);
+// Called for CHR writes and by mappers whenever they switch CHR banks
+void invalidate_tiles(Emulator *emu, Word address, int size);
 
-Byte cpu_to_ppu_read(Word address);
+Byte cpu_to_ppu_read(Emulator *emu, Word address);
 
-Byte cpu_to_ppu_write(Word address, Byte data);
+Byte cpu_to_ppu_write(Emulator *emu, Word address, Byte data);
 
 #endif //PPU_H
@@ -0,0 +1,24 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+
+/* Per subsystem counters, only updated in builds with PROFILE_SUBSYSTEMS defined (the bench target).
+   Times are in SDL performance counter ticks, CPU time is whatever a run took besides PPU and mapper */
+typedef struct {
+    uint64_t instructions;              // Interpreter dispatches, skipped idle iterations and JIT blocks excluded
+    uint64_t ppu_ticks;                 // Inside sync_ppu(), CHR fetches of the renderer included
+    uint64_t mapper_ticks;              // Mapper register reads and writes from the CPU, bank switches included
+} Profile;
+
+#ifdef PROFILE_SUBSYSTEMS
+#define PROFILE_BEGIN(name) uint64_t name = SDL_GetPerformanceCounter()
+#define PROFILE_END(name, counter) ((counter) += SDL_GetPerformanceCounter() - (name))
+#define PROFILE_ADD(counter, value) ((counter) += (value))
+#else
+#define PROFILE_BEGIN(name)
+#define PROFILE_END(name, counter)
+#define PROFILE_ADD(counter, value)
+#endif
+
+#endif // !PROFILE_H
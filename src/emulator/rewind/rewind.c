@@ -0,0 +1,294 @@
+#include <stdbool.h>
+#include <string.h>
+#include <SDL2/SDL.h>
+
+#include "rewind.h"
+#include "../emulator.h"
+#include "../savestate/savestate.h"
+#include "../../utils.h"
+
+#define RLE_MIN_GAP 4                   // Unchanged bytes that end a literal run
+#define INITIAL_SNAPSHOTS 256
+
+typedef struct {
+    size_t offset;                      // Into the data ring
+    size_t size;
+    uint64_t sequence;
+    bool keyframe;
+} Snapshot;
+
+/* Snapshots are appended to one allocation used as a circular log, the live bytes run from the oldest
+   snapshot to head and wrap to the start when the end can't hold the next one */
+struct Rewind {
+    Byte *data;
+    size_t budget;
+    size_t head;
+    Snapshot *snapshots;                // Circular, oldest first
+    int first;
+    int count;
+    int capacity;
+    int keyframe_interval;
+    int since_keyframe;                 // Deltas pushed against the current keyframe
+    uint64_t next_sequence;
+    size_t state_size;
+    Byte *state;                        // Savestate being encoded or restored
+    Byte *keyframe;                     // Decoded keyframe new deltas are XORed against
+    uint64_t keyframe_sequence;
+    bool keyframe_valid;
+    Byte *zeros;                        // Keyframes are encoded against zeros
+    Byte *encoded;                      // Worst case encoding of one snapshot
+    size_t bytes_used;
+    int keyframes;
+    double last_restore_us;
+};
+
+static size_t encode_delta(const Byte *base, const Byte *state, size_t size, Byte *out);
+static void apply_delta(Byte *state, const Byte *delta, size_t size);
+static Byte *put_varint(Byte *out, size_t value);
+static const Byte *get_varint(const Byte *in, size_t *value);
+static bool reserve(Rewind *rewind, size_t size, size_t *offset);
+static void drop_oldest(Rewind *rewind);
+static int append_snapshot(Rewind *rewind, Snapshot snapshot);
+
+static Snapshot *snapshot_at(const Rewind *rewind, int index) {
+    // 0 is the oldest snapshot, count - 1 the newest
+    return &rewind->snapshots[(rewind->first + index) % rewind->capacity];
+}
+
+Rewind *create_rewind(size_t budget, int keyframe_interval) {
+    size_t state_size = savestate_size();
+    size_t encoded_max = state_size * 2 + 16;
+    if (budget < encoded_max) {
+        ERROR("Rewind budget of %d bytes can't hold a keyframe", (int) budget);
+        return NULL;
+    }
+    Rewind *rewind = calloc(1, sizeof(Rewind));
+    if (rewind == NULL)
+        return NULL;
+    *rewind = (Rewind) {
+        .data = malloc(budget), .budget = budget,
+        .snapshots = malloc(INITIAL_SNAPSHOTS * sizeof(Snapshot)), .capacity = INITIAL_SNAPSHOTS,
+        .keyframe_interval = (keyframe_interval > 0) ? keyframe_interval : REWIND_KEYFRAME_INTERVAL,
+        .state_size = state_size,
+        .state = malloc(state_size), .keyframe = malloc(state_size),
+        .zeros = calloc(1, state_size), .encoded = malloc(encoded_max),
+    };
+    if (!rewind->data || !rewind->snapshots || !rewind->state || !rewind->keyframe || !rewind->zeros ||
+        !rewind->encoded) {
+        ERROR("Unable to allocate a rewind budget of %d bytes", (int) budget);
+        destroy_rewind(rewind);
+        return NULL;
+    }
+    return rewind;
+}
+
+void destroy_rewind(Rewind *rewind) {
+    if (rewind == NULL)
+        return;
+    free(rewind->data);
+    free(rewind->snapshots);
+    free(rewind->state);
+    free(rewind->keyframe);
+    free(rewind->zeros);
+    free(rewind->encoded);
+    free(rewind);
+}
+
+int rewind_push(Rewind *rewind, const Emulator *emu) {
+    save_state(emu, rewind->state, rewind->state_size);
+    bool keyframe = !rewind->keyframe_valid || rewind->since_keyframe >= rewind->keyframe_interval;
+    size_t size, offset;
+    for (;;) {
+        size = encode_delta(keyframe ? rewind->zeros : rewind->keyframe, rewind->state, rewind->state_size,
+                            rewind->encoded);
+        if (!reserve(rewind, size, &offset))
+            ERROR_RETURN("Snapshot of %d bytes doesn't fit the rewind budget", (int) size);
+        // Making room can drop the keyframe this delta was encoded against
+        if (keyframe || rewind->count > 0)
+            break;
+        keyframe = true;
+    }
+
+    Snapshot snapshot = {.offset = offset, .size = size, .sequence = rewind->next_sequence++, .keyframe = keyframe};
+    if (append_snapshot(rewind, snapshot) < 0)
+        return -1;
+    memcpy(rewind->data + offset, rewind->encoded, size);
+    rewind->head = offset + size;
+    rewind->bytes_used += size;
+    if (keyframe) {
+        memcpy(rewind->keyframe, rewind->state, rewind->state_size);
+        rewind->keyframe_sequence = snapshot.sequence;
+        rewind->keyframe_valid = true;
+        rewind->keyframes++;
+        rewind->since_keyframe = 0;
+    }
+    else
+        rewind->since_keyframe++;
+    return 0;
+}
+
+int rewind_step_back(Rewind *rewind, Emulator *emu) {
+    if (rewind->count == 0)
+        return -1;
+    uint64_t start = SDL_GetPerformanceCounter();
+    int newest = rewind->count - 1, key = newest;
+    while (!snapshot_at(rewind, key)->keyframe)
+        key--;
+    Snapshot snapshot = *snapshot_at(rewind, newest);
+    const Snapshot *keyframe = snapshot_at(rewind, key);
+
+    if (!rewind->keyframe_valid || rewind->keyframe_sequence != keyframe->sequence) {
+        memset(rewind->keyframe, 0, rewind->state_size);
+        apply_delta(rewind->keyframe, rewind->data + keyframe->offset, keyframe->size);
+        rewind->keyframe_sequence = keyframe->sequence;
+        rewind->keyframe_valid = true;
+    }
+    memcpy(rewind->state, rewind->keyframe, rewind->state_size);
+    if (!snapshot.keyframe)
+        apply_delta(rewind->state, rewind->data + snapshot.offset, snapshot.size);
+    int status = load_state(emu, rewind->state, rewind->state_size);
+
+    // Restored snapshots are dropped, the next push continues from here
+    rewind->count--;
+    if (rewind->count) {
+        // The freed bytes may sit right before the oldest snapshot, the next push goes after the newest one
+        const Snapshot *last = snapshot_at(rewind, rewind->count - 1);
+        rewind->head = last->offset + last->size;
+    }
+    else
+        rewind->head = 0;
+    rewind->bytes_used -= snapshot.size;
+    if (snapshot.keyframe) {
+        rewind->keyframes--;
+        rewind->keyframe_valid = false;
+    }
+    else
+        rewind->since_keyframe = newest - 1 - key;
+    rewind->last_restore_us = (double) (SDL_GetPerformanceCounter() - start) * 1e6 / SDL_GetPerformanceFrequency();
+    return status;
+}
+
+Rewind_stats rewind_stats(const Rewind *rewind) {
+    return (Rewind_stats) {
+        .snapshots = rewind->count,
+        .keyframes = rewind->keyframes,
+        .bytes_used = rewind->bytes_used,
+        .budget = rewind->budget,
+        .bytes_per_snapshot = (rewind->count) ? (double) rewind->bytes_used / rewind->count : 0.0,
+        .last_restore_us = rewind->last_restore_us
+    };
+}
+
+static size_t encode_delta(const Byte *base, const Byte *state, size_t size, Byte *out) {
+    /* Pairs of (unchanged bytes to skip, literal length) followed by the literal XORed with base.
+       Literals only end after RLE_MIN_GAP unchanged bytes, shorter gaps cost less to keep inline */
+    Byte *start = out;
+    size_t i = 0;
+    while (i < size) {
+        size_t skip_start = i;
+        while (i + 8 <= size && memcmp(base + i, state + i, 8) == 0)
+            i += 8;
+        while (i < size && base[i] == state[i])
+            i++;
+        size_t literal_start = i, end = i;
+        while (i < size && i - end < RLE_MIN_GAP) {
+            if (base[i] != state[i]) end = i + 1;
+            i++;
+        }
+        out = put_varint(out, literal_start - skip_start);
+        out = put_varint(out, end - literal_start);
+        for (size_t j = literal_start; j < end; j++)
+            *out++ = base[j] ^ state[j];
+        i = end;
+    }
+    return out - start;
+}
+
+static void apply_delta(Byte *state, const Byte *delta, size_t size) {
+    const Byte *end = delta + size;
+    size_t position = 0;
+    while (delta < end) {
+        size_t skip, length;
+        delta = get_varint(delta, &skip);
+        delta = get_varint(delta, &length);
+        position += skip;
+        for (size_t j = 0; j < length; j++)
+            state[position + j] ^= delta[j];
+        position += length;
+        delta += length;
+    }
+}
+
+static Byte *put_varint(Byte *out, size_t value) {
+    // 7 bits per byte, high bit set while more bytes follow
+    while (value >= 0x80) {
+        *out++ = (Byte) (value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (Byte) value;
+    return out;
+}
+
+static const Byte *get_varint(const Byte *in, size_t *value) {
+    size_t result = 0;
+    int shift = 0;
+    while (*in & 0x80) {
+        result |= (size_t) (*in++ & 0x7F) << shift;
+        shift += 7;
+    }
+    *value = result | ((size_t) *in++ << shift);
+    return in;
+}
+
+static bool reserve(Rewind *rewind, size_t size, size_t *offset) {
+    if (size > rewind->budget)
+        return false;
+    for (;;) {
+        if (rewind->count == 0) {
+            *offset = 0;
+            return true;
+        }
+        size_t tail = snapshot_at(rewind, 0)->offset;
+        bool wrapped = snapshot_at(rewind, rewind->count - 1)->offset < tail;
+        if (!wrapped && rewind->head + size <= rewind->budget) {
+            *offset = rewind->head;
+            return true;
+        }
+        if (!wrapped && size <= tail) {
+            *offset = 0;
+            return true;
+        }
+        if (wrapped && rewind->head + size <= tail) {
+            *offset = rewind->head;
+            return true;
+        }
+        drop_oldest(rewind);
+    }
+}
+
+static void drop_oldest(Rewind *rewind) {
+    // Deltas are useless without their keyframe, they go with it
+    do {
+        Snapshot *oldest = snapshot_at(rewind, 0);
+        rewind->bytes_used -= oldest->size;
+        if (oldest->keyframe) rewind->keyframes--;
+        rewind->first = (rewind->first + 1) % rewind->capacity;
+        rewind->count--;
+    } while (rewind->count > 0 && !snapshot_at(rewind, 0)->keyframe);
+}
+
+static int append_snapshot(Rewind *rewind, Snapshot snapshot) {
+    if (rewind->count == rewind->capacity) {
+        Snapshot *snapshots = malloc(rewind->capacity * 2 * sizeof(Snapshot));
+        if (snapshots == NULL)
+            ERROR_RETURN("Unable to allocate %d rewind snapshots", rewind->capacity * 2);
+        for (int i = 0; i < rewind->count; i++)
+            snapshots[i] = *snapshot_at(rewind, i);
+        free(rewind->snapshots);
+        rewind->snapshots = snapshots;
+        rewind->first = 0;
+        rewind->capacity *= 2;
+    }
+    *snapshot_at(rewind, rewind->count++) = snapshot;
+    return 0;
+}
@@ -0,0 +1,37 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <stddef.h>
+
+#include "../../types.h"
+
+#define REWIND_KEYFRAME_INTERVAL 60     // Snapshots per keyframe, one second of frames
+
+/* Ring of savestates inside a fixed memory budget, the oldest snapshots are dropped to make room.
+   Every snapshot is XORed against the last keyframe and run length encoded, so a restore decodes at
+   most one keyframe and one delta */
+typedef struct Rewind Rewind;
+
+typedef struct {
+    int snapshots;
+    int keyframes;
+    size_t bytes_used;                  // Encoded snapshots, without the fixed buffers
+    size_t budget;
+    double bytes_per_snapshot;
+    double last_restore_us;             // Decode and load_state() of the last step back
+} Rewind_stats;
+
+// NULL when the budget can't hold a single keyframe or is out of memory
+Rewind *create_rewind(size_t budget, int keyframe_interval);
+
+void destroy_rewind(Rewind *rewind);
+
+// Appends a snapshot of emu, -1 when the snapshot can't be encoded
+int rewind_push(Rewind *rewind, const Emulator *emu);
+
+// Loads the newest snapshot into emu and drops it, -1 when there is nothing left to rewind to
+int rewind_step_back(Rewind *rewind, Emulator *emu);
+
+Rewind_stats rewind_stats(const Rewind *rewind);
+
+#endif // !REWIND_H
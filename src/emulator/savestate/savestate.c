@@ -0,0 +1,219 @@
+#include <string.h>
+
+#include "savestate.h"
+#include "../emulator.h"
+#include "../../utils.h"
+
+#define SAVESTATE_MAGIC "NESS"
+
+// Field by field size of the layout written below
+#define HEADER_SIZE (4 + 2 + 2)
+#define CPU_STATE_SIZE (2 + 2 + 3 + 4 + 1 + 2048 + 18)
+#define PPU_STATE_SIZE (8 + 3 + 2 + 2 + 3 + 4 * 1024 + 32 + 1 + 4 + 4 + 1 + 1 + 8 + 1)
+#define CONTROLLER_STATE_SIZE (CONTROLLER_PORTS + 1)
+#define MAPPER_STATE_SIZE (2 + 1)
+#define SCHEDULER_STATE_SIZE (1 + EVENT_COUNT * (1 + 8))
+#define CLOCK_STATE_SIZE (8 + 8)
+#define MAPPER_OFFSET (HEADER_SIZE + CPU_STATE_SIZE + PPU_STATE_SIZE + CONTROLLER_STATE_SIZE)
+#define SCHEDULER_OFFSET (MAPPER_OFFSET + MAPPER_STATE_SIZE)
+#define STATE_SIZE (SCHEDULER_OFFSET + SCHEDULER_STATE_SIZE + CLOCK_STATE_SIZE)
+
+static Byte *put_bytes(Byte *out, const void *data, size_t size);
+static Byte *put_word(Byte *out, Word data);
+static Byte *put_u32(Byte *out, uint32_t data);
+static Byte *put_u64(Byte *out, uint64_t data);
+static const Byte *get_bytes(const Byte *in, void *data, size_t size);
+static const Byte *get_word(const Byte *in, Word *data);
+static const Byte *get_u32(const Byte *in, uint32_t *data);
+static const Byte *get_u64(const Byte *in, uint64_t *data);
+static Event_callback event_callback(enum Event_type type);
+
+size_t savestate_size(void) {
+    return STATE_SIZE;
+}
+
+size_t save_state(const Emulator *emu, Byte *buffer, size_t size) {
+    if (size < STATE_SIZE)
+        return 0;
+    const CPU *cpu = &emu->cpu;
+    const PPU *ppu = &emu->ppu;
+    const Scheduler *scheduler = &emu->scheduler;
+    Byte *out = buffer;
+
+    out = put_bytes(out, SAVESTATE_MAGIC, 4);
+    out = put_word(out, SAVESTATE_VERSION);
+    out = put_word(out, 0);                     // Reserved
+
+    out = put_word(out, cpu->PC);
+    out = put_word(out, cpu->SP);
+    *out++ = cpu->A; *out++ = cpu->X; *out++ = cpu->Y;
+    *out++ = cpu->P; *out++ = cpu->n_result; *out++ = cpu->v_result; *out++ = cpu->z_result;
+    *out++ = cpu->irq_line;
+    out = put_bytes(out, cpu->Bus.RAM, sizeof(cpu->Bus.RAM));
+    out = put_bytes(out, cpu->Bus.APU_registers, sizeof(cpu->Bus.APU_registers));
+
+    out = put_bytes(out, ppu->PPU_registers, sizeof(ppu->PPU_registers));
+    *out++ = ppu->PPUCTRL._; *out++ = ppu->PPUMASK._; *out++ = ppu->PPUSTATUS._;
+    out = put_word(out, ppu->current_address._);
+    out = put_word(out, ppu->temp_address._);
+    *out++ = ppu->fine_x; *out++ = ppu->PPUDATA; *out++ = ppu->write_latch;
+    out = put_bytes(out, ppu->Bus.Nametable, sizeof(ppu->Bus.Nametable));
+    out = put_bytes(out, ppu->Bus.Palettes, sizeof(ppu->Bus.Palettes));
+    *out++ = ppu->VRAM_increment;
+    out = put_u32(out, (uint32_t) ppu->dots);
+    out = put_u32(out, (uint32_t) ppu->scanlines);
+    *out++ = ppu->frame_complete;
+    *out++ = ppu->odd_frame;
+    out = put_u64(out, (uint64_t) ppu->synced_cycles);
+    *out++ = ppu->create_nmi;
+
+    // Held buttons are input, not state, the frontend or movie sets them again before the next frame
+    out = put_bytes(out, emu->controllers.shift, CONTROLLER_PORTS);
+    *out++ = emu->controllers.strobe;
+
+    // Cartridge contents come from the ROM file, only the mapper is checked and its registers saved
+    out = put_word(out, emu->mapper.mapper_num);
+    *out++ = (Byte) emu->mapper.mirroring;
+
+    // Pending events in queue order, callbacks are looked up again by type when loading
+    *out++ = (Byte) scheduler->queue_length;
+    for (int i = 0; i < EVENT_COUNT; i++) {
+        const Event *event = &scheduler->queue[i];
+        *out++ = (i < scheduler->queue_length) ? (Byte) event->type : 0;
+        out = put_u64(out, (i < scheduler->queue_length) ? (uint64_t) event->cycle : 0);
+    }
+
+    out = put_u64(out, (uint64_t) emu->cycles);
+    out = put_u64(out, (uint64_t) emu->cycle_overshoot);
+    return out - buffer;
+}
+
+int load_state(Emulator *emu, const Byte *buffer, size_t size) {
+    if (size < STATE_SIZE)
+        ERROR_RETURN("Savestate too short (size: %d)", (int) size);
+    if (memcmp(buffer, SAVESTATE_MAGIC, 4) != 0)
+        ERROR_RETURN("Not a savestate (magic: %.4s)", (const char *) buffer);
+    Word version, mapper_num;
+    get_word(buffer + 4, &version);
+    if (version != SAVESTATE_VERSION)
+        ERROR_RETURN("Unsupported savestate version %d", version);
+    get_word(buffer + MAPPER_OFFSET, &mapper_num);
+    if (mapper_num != emu->mapper.mapper_num)
+        ERROR_RETURN("Savestate is for mapper %d, not for the loaded cartridge", mapper_num);
+    if (buffer[MAPPER_OFFSET + 2] > FOUR_SCREEN)
+        ERROR_RETURN("Corrupted savestate (mirroring %d)", buffer[MAPPER_OFFSET + 2]);
+    if (buffer[SCHEDULER_OFFSET] > EVENT_COUNT)
+        ERROR_RETURN("Corrupted savestate (%d pending events)", buffer[SCHEDULER_OFFSET]);
+
+    CPU *cpu = &emu->cpu;
+    PPU *ppu = &emu->ppu;
+    Scheduler *scheduler = &emu->scheduler;
+    const Byte *in = buffer + HEADER_SIZE;
+    uint32_t value;
+    uint64_t value64;
+
+    in = get_word(in, &cpu->PC);
+    in = get_word(in, &cpu->SP);
+    cpu->A = *in++; cpu->X = *in++; cpu->Y = *in++;
+    cpu->P = *in++; cpu->n_result = *in++; cpu->v_result = *in++; cpu->z_result = *in++;
+    cpu->irq_line = *in++;
+    in = get_bytes(in, cpu->Bus.RAM, sizeof(cpu->Bus.RAM));
+    in = get_bytes(in, cpu->Bus.APU_registers, sizeof(cpu->Bus.APU_registers));
+
+    in = get_bytes(in, ppu->PPU_registers, sizeof(ppu->PPU_registers));
+    ppu->PPUCTRL._ = *in++; ppu->PPUMASK._ = *in++; ppu->PPUSTATUS._ = *in++;
+    in = get_word(in, &ppu->current_address._);
+    in = get_word(in, &ppu->temp_address._);
+    ppu->fine_x = *in++; ppu->PPUDATA = *in++; ppu->write_latch = *in++;
+    in = get_bytes(in, ppu->Bus.Nametable, sizeof(ppu->Bus.Nametable));
+    in = get_bytes(in, ppu->Bus.Palettes, sizeof(ppu->Bus.Palettes));
+    ppu->palette_valid = false;
+    ppu->VRAM_increment = *in++;
+    in = get_u32(in, &value); ppu->dots = (int32_t) value;
+    in = get_u32(in, &value); ppu->scanlines = (int32_t) value;
+    ppu->frame_complete = *in++;
+    ppu->odd_frame = *in++;
+    in = get_u64(in, &value64); ppu->synced_cycles = (int64_t) value64;
+    ppu->create_nmi = *in++;
+    // The screen isn't saved, the loaded line counts as drawn up to the current dot
+    ppu->drawn_x = scanline_due_x(ppu);
+
+    in = get_bytes(in, emu->controllers.shift, CONTROLLER_PORTS);
+    emu->controllers.strobe = *in++;
+
+    in += 2;                        // Mapper number, checked above
+    emu->mapper.mirroring = (enum Mirror_type) *in++;
+    map_nametables(emu);
+    // NROM has no registers, mappers with bank switching restore them here
+
+    scheduler->queue_length = *in++;
+    for (int i = 0; i < EVENT_COUNT; i++) {
+        Event *event = &scheduler->queue[i];
+        event->type = (enum Event_type) *in++;
+        in = get_u64(in, &value64);
+        event->cycle = (int64_t) value64;
+        event->callback = event_callback(event->type);
+    }
+    scheduler->next_event_cycle = (scheduler->queue_length) ? scheduler->queue[0].cycle : NO_EVENT;
+
+    in = get_u64(in, &value64); emu->cycles = (int64_t) value64;
+    in = get_u64(in, &value64); emu->cycle_overshoot = (int64_t) value64;
+    return 0;
+}
+
+static Event_callback event_callback(enum Event_type type) {
+    switch (type) {
+        case EVENT_PPU_VBLANK: return ppu_vblank_event;
+        case EVENT_PPU_FRAME: return ppu_frame_event;
+        case EVENT_NMI: return cpu_nmi_event;
+        case EVENT_IRQ: return cpu_irq_event;
+        default: return NULL;       // Budget and step events only mark where a run stops
+    }
+}
+
+static Byte *put_bytes(Byte *out, const void *data, size_t size) {
+    memcpy(out, data, size);
+    return out + size;
+}
+
+static Byte *put_word(Byte *out, Word data) {
+    out[0] = (Byte) data;
+    out[1] = (Byte) (data >> 8);
+    return out + 2;
+}
+
+static Byte *put_u32(Byte *out, uint32_t data) {
+    out = put_word(out, (Word) data);
+    return put_word(out, (Word) (data >> 16));
+}
+
+static Byte *put_u64(Byte *out, uint64_t data) {
+    out = put_u32(out, (uint32_t) data);
+    return put_u32(out, (uint32_t) (data >> 32));
+}
+
+static const Byte *get_bytes(const Byte *in, void *data, size_t size) {
+    memcpy(data, in, size);
+    return in + size;
+}
+
+static const Byte *get_word(const Byte *in, Word *data) {
+    *data = (Word) (in[0] | (in[1] << 8));
+    return in + 2;
+}
+
+static const Byte *get_u32(const Byte *in, uint32_t *data) {
+    Word low, high;
+    in = get_word(in, &low);
+    in = get_word(in, &high);
+    *data = low | ((uint32_t) high << 16);
+    return in;
+}
+
+static const Byte *get_u64(const Byte *in, uint64_t *data) {
+    uint32_t low, high;
+    in = get_u32(in, &low);
+    in = get_u32(in, &high);
+    *data = low | ((uint64_t) high << 32);
+    return in;
+}
@@ -0,0 +1,23 @@
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+#include <stddef.h>
+
+#include "../../types.h"
+
+#define SAVESTATE_VERSION 3
+
+/* Versioned little endian snapshot of everything that decides what the console does next: CPU registers
+   and RAM, PPU registers and VRAM, controller shift registers, pending events and the master clock. The screen buffer, the SDL texture
+   and the decode / JIT caches are left out, the caches rebuild themselves from the cartridge */
+
+// Bytes save_state() writes, the same for every instance
+size_t savestate_size(void);
+
+// Returns the bytes written, 0 when the buffer is smaller than savestate_size()
+size_t save_state(const Emulator *emu, Byte *buffer, size_t size);
+
+// The instance must have the same cartridge loaded and be initialized, -1 when the state doesn't fit it
+int load_state(Emulator *emu, const Byte *buffer, size_t size);
+
+#endif // !SAVESTATE_H
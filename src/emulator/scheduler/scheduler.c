@@ -0,0 +1,50 @@
+#include "scheduler.h"
+#include "../emulator.h"
+
+static void remove_event(Scheduler *scheduler, int index);
+
+void reset_scheduler(Emulator *emu) {
+    emu->scheduler.queue_length = 0;
+    emu->scheduler.next_event_cycle = NO_EVENT;
+}
+
+void schedule_event(Emulator *emu, enum Event_type type, int64_t cycle, Event_callback callback) {
+    Scheduler *scheduler = &emu->scheduler;
+    cancel_event(emu, type);
+    int index = scheduler->queue_length;
+    // Events due on the same cycle keep the order they were scheduled in
+    while (index > 0 && scheduler->queue[index - 1].cycle > cycle) {
+        scheduler->queue[index] = scheduler->queue[index - 1];
+        index--;
+    }
+    scheduler->queue[index] = (Event) {.cycle = cycle, .type = type, .callback = callback};
+    scheduler->queue_length++;
+    scheduler->next_event_cycle = scheduler->queue[0].cycle;
+}
+
+void cancel_event(Emulator *emu, enum Event_type type) {
+    Scheduler *scheduler = &emu->scheduler;
+    for (int i = 0; i < scheduler->queue_length; i++) {
+        if (scheduler->queue[i].type == type) {
+            remove_event(scheduler, i);
+            return;
+        }
+    }
+}
+
+void run_due_events(Emulator *emu) {
+    Scheduler *scheduler = &emu->scheduler;
+    // Callbacks may run CPU cycles (NMI, IRQ) and schedule further events
+    while (scheduler->queue_length && scheduler->queue[0].cycle <= emu->cycles) {
+        Event event = scheduler->queue[0];
+        remove_event(scheduler, 0);
+        if (event.callback) event.callback(emu);
+    }
+}
+
+static void remove_event(Scheduler *scheduler, int index) {
+    for (int i = index; i < scheduler->queue_length - 1; i++)
+        scheduler->queue[i] = scheduler->queue[i + 1];
+    scheduler->queue_length--;
+    scheduler->next_event_cycle = (scheduler->queue_length) ? scheduler->queue[0].cycle : NO_EVENT;
+}
@@ -0,0 +1,47 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <stdint.h>
+
+#include "../../types.h"
+
+#define NO_EVENT INT64_MAX
+
+// One pending entry per event type, rescheduling a type replaces its entry
+enum Event_type {
+    EVENT_PPU_VBLANK,       // PPU reaches scanline 241 dot 1
+    EVENT_PPU_FRAME,        // PPU completes a frame
+    EVENT_NMI,
+    EVENT_IRQ,
+    EVENT_APU_FRAME,        // APU frame counter IRQ
+    EVENT_DMC_DMA,          // DMC sample fetch
+    EVENT_MAPPER_IRQ,       // Mapper scanline / cycle counter IRQ
+    EVENT_RUN_BUDGET,       // End of a run_cycles() budget
+    EVENT_CPU_STEP,         // The JIT hands one instruction to the interpreter
+    EVENT_COUNT
+};
+
+typedef void (*Event_callback)(Emulator *emu);
+
+typedef struct {
+    int64_t cycle;          // Master clock (CPU cycle) the event is due at
+    enum Event_type type;
+    Event_callback callback;
+} Event;
+
+typedef struct {
+    // Cycle of the earliest pending event, the CPU runs freely until the master clock reaches it
+    int64_t next_event_cycle;
+    Event queue[EVENT_COUNT];           // Sorted by due cycle, earliest first
+    int queue_length;
+} Scheduler;
+
+void reset_scheduler(Emulator *emu);
+
+void schedule_event(Emulator *emu, enum Event_type type, int64_t cycle, Event_callback callback);
+
+void cancel_event(Emulator *emu, enum Event_type type);
+
+void run_due_events(Emulator *emu);
+
+#endif // !SCHEDULER_H
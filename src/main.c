@@ -1,25 +1,52 @@
 #include <stdbool.h>
+#include <string.h>
 #include <sys/time.h>
 
 #define SDL_MAIN_HANDLED
 #include <SDL2/SDL.h>
 
 #include "utils.h"
-#include "emulator/global.h"
+#include "emulator/emulator.h"
 #include "emulator/cartridge/cartridge.h"
+#include "emulator/rewind/rewind.h"
+#include "emulator/savestate/savestate.h"
+#include "emulator/movie/movie.h"
+#include "emulator/ppu/pixels.h"
+#include "batch/batch.h"
 
 #define WINDOW_WIDTH 512
 #define WINDOW_HEIGHT 480
 
+#define HEADLESS_DEFAULT_FRAMES 600
+#define FRAME_BUDGET_US (1e6 / 60.0988)     // One NTSC frame
+
 typedef struct timer {
     uint64_t start_time;
     uint64_t duration;
 } timer;
 
-int64_t cycle_count = 0;
+Emulator *emu = NULL;
 bool emulator_running = false;
+bool headless = false;
+bool use_jit = false;
+uint32_t frame_limit = 0;
+char *rom_path = NULL;
+char *batch_path = NULL;
+int batch_threads = 0;
+uint32_t rewind_mb = 0;
+Rewind *rewind_ring = NULL;
+uint32_t run_ahead = 0;
+Byte *run_ahead_state = NULL;
+char *record_path = NULL;
+char *play_path = NULL;
+uint32_t checkpoint_interval = 0;
+Movie *movie = NULL;
+int movie_status = 0;                   // 1 once playback ran out of frames, -1 after a desync
+Byte pending_commands = 0;              // Reset and power cycle requests for the next frame
 uint32_t frames;
-char FPS_str[12];
+uint64_t frame_cost_us, worst_frame_cost_us;   // Emulation time of the frames since the last report
+uint32_t cost_frames;
+char FPS_str[64];
 timer fps_timer = {
     .duration = 1000000,
 };
@@ -28,8 +55,16 @@ SDL_Window *window;
 SDL_Renderer *renderer;
 SDL_Event event;
 
-static int init_emulator(CPU *cpu, PPU *ppu, Mapper *mapper, int argc, char *argv[]);
+static int parse_args(int argc, char *argv[]);
+static int init_emulator(int argc, char *argv[]);
 static int get_graphics_contexts(void);
+static void run_headless(void);
+static void emulate_frame(void);
+static void run_frame_ahead(void);
+static void report_frame_cost(void);
+static void read_keyboard(void);
+static int finish_movie(void);
+static void report_rewind(void);
 static void exit_emulator(void);
 static void manage_events(SDL_Event *p_event);
 static void draw_to_screen(void);
@@ -37,20 +72,27 @@ static void update_fps(void);
 static uint64_t get_time_us(void);
 
 int main(int argc, char *argv[]){
-    CPU cpu;
-    PPU ppu;
-    Mapper mapper = (Mapper) {
-        .PRG_ROM_banks = 0, .CHR_ROM_banks = 0,
-        .PRG_ROM_p = NULL, .CHR_ROM_p = NULL,
-    };
-
-    int status = init_emulator(&cpu, &ppu, &mapper, argc, argv);
+    int status = init_emulator(argc, argv);
     if (status != 0) {
         exit_emulator();
         if (status < 0) ERROR_EXIT("Unable to initialize emulator, Exited program with status: %d", status);
         return status;
     };
 
+    if (batch_path) {
+        status = run_batch(batch_path, batch_threads, use_jit);
+        exit_emulator();
+        if (status < 0) ERROR_EXIT("Unable to run batch %s, Exited program with status: %d", batch_path, status);
+        return (status) ? EXIT_FAILURE : 0;
+    }
+
+    if (headless) {
+        run_headless();
+        status = finish_movie();
+        exit_emulator();
+        return (status) ? EXIT_FAILURE : 0;
+    }
+
     status = get_graphics_contexts();
     if (status < 0) {
         exit_emulator();
@@ -61,53 +103,278 @@ int main(int argc, char *argv[]){
     fps_timer.start_time = get_time_us();
     while (emulator_running) {
         manage_events(&event);
-        execute_cpu_ppu();
+        emulate_frame();
         draw_to_screen();
         update_fps();
     }
 
+    status = finish_movie();
     exit_emulator();
-    return status;
+    return (status) ? EXIT_FAILURE : 0;
 }
 
 static void manage_events(SDL_Event *p_event) {
-    SDL_PollEvent(p_event);
-    if (event.type == SDL_QUIT) emulator_running = false;
+    while (SDL_PollEvent(p_event)) {
+        if (p_event->type == SDL_QUIT) emulator_running = false;
+        else if (p_event->type == SDL_KEYDOWN && !p_event->key.repeat) {
+            if (p_event->key.keysym.scancode == SDL_SCANCODE_F5) pending_commands |= MOVIE_RESET;
+            else if (p_event->key.keysym.scancode == SDL_SCANCODE_F6) pending_commands |= MOVIE_POWER;
+        }
+    }
+}
+
+static void emulate_frame(void) {
+    uint64_t start_time = get_time_us();
+    if (!headless) read_keyboard();
+    Byte commands = pending_commands;
+    pending_commands = 0;
+    if (movie && movie_status == 0) {
+        // Playback replaces the keyboard, a finished or desynced movie hands control back to it
+        movie_status = movie_next_frame(movie, emu, commands);
+        if (movie_status != 0 && headless)
+            return;
+    }
+    else if (commands)
+        reset_console(emu, commands & MOVIE_POWER);
+
+    // Holding backspace plays the snapshot ring backwards, one frame per frame
+    if (rewind_ring && !headless && SDL_GetKeyboardState(NULL)[SDL_SCANCODE_BACKSPACE] &&
+        rewind_step_back(rewind_ring, emu) == 0)
+        run_frame(emu);                     // The screen buffer isn't in the snapshot, draw it again
+    else {
+        if (rewind_ring) rewind_push(rewind_ring, emu);
+        if (run_ahead) run_frame_ahead();
+        else run_frame(emu);
+    }
+
+    uint64_t cost = get_time_us() - start_time;
+    frame_cost_us += cost;
+    if (cost > worst_frame_cost_us) worst_frame_cost_us = cost;
+    cost_frames++;
+}
+
+static void run_frame_ahead(void) {
+    /* The real frame advances the console but is never shown. The frames after it see the same input,
+       only the last one is drawn, and the console goes back to the real frame before the next one */
+    size_t state_size = savestate_size();
+    emu->ppu.skip_draw = true;
+    run_frame(emu);
+    save_state(emu, run_ahead_state, state_size);
+    for (uint32_t i = 1; i <= run_ahead; i++) {
+        emu->ppu.skip_draw = (i < run_ahead);
+        run_frame(emu);
+    }
+    load_state(emu, run_ahead_state, state_size);  // Keeps frame_complete set, the drawn frame is presented
+}
+
+static void read_keyboard(void) {
+    // Port 0 only, in shift register order: A, B, Select, Start, Up, Down, Left, Right
+    static const SDL_Scancode button_keys[8] = {
+        SDL_SCANCODE_X, SDL_SCANCODE_Z, SDL_SCANCODE_RSHIFT, SDL_SCANCODE_RETURN,
+        SDL_SCANCODE_UP, SDL_SCANCODE_DOWN, SDL_SCANCODE_LEFT, SDL_SCANCODE_RIGHT
+    };
+    const Uint8 *keys = SDL_GetKeyboardState(NULL);
+    Byte buttons = 0;
+    for (int i = 0; i < 8; i++)
+        if (keys[button_keys[i]]) buttons |= 1 << i;
+    emu->controllers.buttons[0] = buttons;
+}
+
+static int finish_movie(void) {
+    if (movie == NULL)
+        return 0;
+    if (movie_status >= 0 && movie_finish(movie, emu) < 0)
+        movie_status = -1;
+    if (record_path) {
+        printf("Movie: %u frames recorded\n", movie_length(movie));
+        return save_movie(movie, record_path);
+    }
+    printf("Movie: %u of %u frames played, %u checkpoints verified%s\n", movie_position(movie), movie_length(movie),
+           movie_verified(movie), (movie_status < 0) ? ", desynced" : "");
+    return (movie_status < 0) ? -1 : 0;
+}
+
+static void report_frame_cost(void) {
+    double average_us = (cost_frames) ? (double) frame_cost_us / cost_frames : 0.0;
+    printf("Frame cost: %.2f ms average, %.2f ms worst, %.0f%% of the %.2f ms frame budget\n",
+           average_us / 1e3, worst_frame_cost_us / 1e3, average_us * 100 / FRAME_BUDGET_US, FRAME_BUDGET_US / 1e3);
 }
 
 static void draw_to_screen(void) {
-    if (p_ppu->frame_complete) {
-        if(SDL_RenderCopy(renderer, (void *)p_ppu->ppu_draw_texture, NULL, NULL) < 0) {
+    if (emu->ppu.frame_complete) {
+        if(SDL_RenderCopy(renderer, (void *)emu->ppu.ppu_draw_texture, NULL, NULL) < 0) {
             ERROR("Unable to draw to screen\n    SDL error: %s", SDL_GetError());
             emulator_running = false;
         }
         SDL_RenderPresent(renderer);
-        p_ppu->frame_complete = false;
+        emu->ppu.frame_complete = false;
+        frames++;
+    }
+}
+
+static void run_headless(void) {
+    // No window, renderer or event polling, the core runs as fast as the host allows
+    if (frame_limit == 0) frame_limit = HEADLESS_DEFAULT_FRAMES;
+
+    uint64_t start_time = get_time_us();
+    while (frames < frame_limit) {
+        emulate_frame();
+        if (movie_status != 0)
+            break;
         frames++;
     }
+    uint64_t elapsed = get_time_us() - start_time;
+
+    double seconds = (elapsed) ? (double) elapsed / 1e6 : 1e-6;
+    printf("Headless run: %u frames, %lld cycles in %.3f s\n", frames, (long long) emu->cycles, seconds);
+    printf("Frames per second: %.2f\nCycles per second: %.0f\n", frames / seconds, emu->cycles / seconds);
+    // A movie can end before the first frame
+    printf("Dispatches removed by fused pairs: %.1f per frame\n",
+           (frames) ? (double) emu->fused_dispatches / frames : 0.0);
+    if (run_ahead) printf("Run-ahead: %u frames\n", run_ahead);
+    report_frame_cost();
+    if (rewind_ring) report_rewind();
+}
+
+static void report_rewind(void) {
+    // Rewinds through the whole ring to time the restores
+    Rewind_stats stats = rewind_stats(rewind_ring);
+    printf("Rewind: %d snapshots (%d keyframes), %.1f bytes per snapshot, %zu of %zu bytes used\n",
+           stats.snapshots, stats.keyframes, stats.bytes_per_snapshot, stats.bytes_used, stats.budget);
+    double restore_us = 0, worst_us = 0;
+    int restored = 0;
+    while (rewind_step_back(rewind_ring, emu) == 0) {
+        double us = rewind_stats(rewind_ring).last_restore_us;
+        restore_us += us;
+        if (us > worst_us) worst_us = us;
+        restored++;
+    }
+    if (restored)
+        printf("Rewind restore: %.2f us average, %.2f us worst\n", restore_us / restored, worst_us);
+}
+
+static int parse_args(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0)
+            headless = true;
+        else if (strcmp(argv[i], "--jit") == 0)
+            use_jit = true;
+        else if (strcmp(argv[i], "--frames") == 0) {
+            if (++i >= argc)
+                ERROR_RETURN("Missing value for %s", "--frames");
+            frame_limit = (uint32_t) strtoul(argv[i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--batch") == 0) {
+            if (++i >= argc)
+                ERROR_RETURN("Missing value for %s", "--batch");
+            batch_path = argv[i];
+            headless = true;                // Batch jobs never open a window
+        }
+        else if (strcmp(argv[i], "--rewind") == 0) {
+            if (++i >= argc)
+                ERROR_RETURN("Missing value for %s", "--rewind");
+            rewind_mb = (uint32_t) strtoul(argv[i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--run-ahead") == 0) {
+            if (++i >= argc)
+                ERROR_RETURN("Missing value for %s", "--run-ahead");
+            run_ahead = (uint32_t) strtoul(argv[i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--record") == 0) {
+            if (++i >= argc)
+                ERROR_RETURN("Missing value for %s", "--record");
+            record_path = argv[i];
+        }
+        else if (strcmp(argv[i], "--play") == 0) {
+            if (++i >= argc)
+                ERROR_RETURN("Missing value for %s", "--play");
+            play_path = argv[i];
+        }
+        else if (strcmp(argv[i], "--checkpoint") == 0) {
+            if (++i >= argc)
+                ERROR_RETURN("Missing value for %s", "--checkpoint");
+            checkpoint_interval = (uint32_t) strtoul(argv[i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--threads") == 0) {
+            if (++i >= argc)
+                ERROR_RETURN("Missing value for %s", "--threads");
+            batch_threads = atoi(argv[i]);
+        }
+        else
+            rom_path = argv[i];
+    }
+    return 0;
 }
 
-static int init_emulator(CPU *cpu, PPU *ppu, Mapper *mapper, int argc, char *argv[]) {
+static int init_emulator(int argc, char *argv[]) {
     printf("Starting Emulator...\n");
 
-    if (argc < 2){
+    int status = parse_args(argc, argv);
+    if (status < 0)
+        return status;
+
+    // Host wide, picked before any batch worker starts drawing
+    set_pixel_pipeline(PIXELS_AUTO);
+
+    if (batch_path)
+        return 0;                           // Every job loads its own cartridge
+
+    if (rom_path == NULL){
         printf("No file to load from\n");
+        printf("Usage: %s [--headless] [--frames N] [--jit] [--rewind MB] [--run-ahead N]\n", argv[0]);
+        printf("       %*s [--record movie.nesm [--checkpoint N] | --play movie.nesm|movie.fm2] rom.nes\n",
+               (int) strlen(argv[0]), "");
+        printf("       %s --batch jobs.txt [--threads N] [--jit]\n", argv[0]);
         return 1;
     }
 
-    int status = SDL_Init(SDL_INIT_EVERYTHING);
-    if (status < 0)
-        ERROR_RETURN("Unable to initialize SDL (flags: %d)\n    SDL error: %s", SDL_INIT_EVERYTHING, SDL_GetError());
+    if (!headless) {
+        status = SDL_Init(SDL_INIT_EVERYTHING);
+        if (status < 0)
+            ERROR_RETURN("Unable to initialize SDL (flags: %d)\n    SDL error: %s", SDL_INIT_EVERYTHING, SDL_GetError());
+    }
 
-    _set_global_vars(cpu, ppu, mapper);
-    reset_cpu();
-    reset_ppu();
+    emu = create_emulator();
+    if (emu == NULL)
+        ERROR_RETURN("Unable to allocate %d bytes for the emulator", (int) sizeof(Emulator));
+    reset_cpu(emu);
+    reset_ppu(emu);
 
-    status = load_cartridge(argv[1]);
+    status = load_cartridge(&emu->mapper, rom_path);
     if (status < 0)
-        ERROR_RETURN("Unable to load NES cartridge %s", argv[1]);
+        ERROR_RETURN("Unable to load NES cartridge %s", rom_path);
 
-    init_cpu(&cycle_count);
+    init_cpu(emu);
+    if (use_jit && !set_cpu_backend(emu, CPU_JIT))
+        printf("JIT not available on this host, using the interpreter\n");
+
+    if (rewind_mb) {
+        rewind_ring = create_rewind((size_t) rewind_mb << 20, REWIND_KEYFRAME_INTERVAL);
+        if (rewind_ring == NULL)
+            ERROR_RETURN("Unable to create a rewind buffer of %u MB", rewind_mb);
+    }
+
+    if (record_path && play_path)
+        ERROR_RETURN("Choose one of %s and %s", "--record", "--play");
+    if ((record_path || play_path) && rewind_ring)
+        ERROR_RETURN("Rewinding would leave the movie behind, %s can't be combined with a movie", "--rewind");
+    if (record_path) {
+        movie = create_movie(emu, checkpoint_interval);
+        if (movie == NULL)
+            ERROR_RETURN("Unable to start recording %s", record_path);
+    }
+    if (play_path) {
+        movie = load_movie(play_path);
+        if (movie == NULL)
+            ERROR_RETURN("Unable to load movie %s", play_path);
+        if (frame_limit == 0) frame_limit = movie_length(movie);
+    }
+
+    if (run_ahead) {
+        run_ahead_state = malloc(savestate_size());
+        if (run_ahead_state == NULL)
+            ERROR_RETURN("Unable to allocate %d bytes for the run-ahead state", (int) savestate_size());
+    }
 
     return 0;
 }
@@ -125,7 +392,7 @@ static int get_graphics_contexts(void) {
     if (renderer == NULL)
         ERROR_RETURN("Unable to create Renderer (index: %d, flags: %d)", -1, 0);
     
-    int status = init_ppu(renderer);
+    int status = init_ppu(emu, renderer);
     if (status < 0)
         ERROR_RETURN("Unable to initialize PPU\n    SDL error: %s", SDL_GetError());
 
@@ -133,19 +400,33 @@ static int get_graphics_contexts(void) {
 }
 
 static void exit_emulator(void) {
-    printf("Exiting Emulator\nCycle count: %d\n", cycle_count);
-    exit_cpu();
-    SDL_DestroyWindow(window);
-    SDL_DestroyRenderer(renderer);
-    SDL_DestroyTexture(p_ppu->ppu_draw_texture);
-    SDL_Quit();
+    printf("Exiting Emulator\nCycle count: %lld\n", (long long) (emu ? emu->cycles : 0));
+    if (!headless) {
+        SDL_DestroyWindow(window);
+        SDL_DestroyRenderer(renderer);
+        if (emu) SDL_DestroyTexture(emu->ppu.ppu_draw_texture);
+        SDL_Quit();
+    }
+    destroy_rewind(rewind_ring);
+    rewind_ring = NULL;
+    destroy_movie(movie);
+    movie = NULL;
+    free(run_ahead_state);
+    run_ahead_state = NULL;
+    destroy_emulator(emu);
+    emu = NULL;
 }
 
 static void update_fps(void) {
     if (get_time_us() >= (fps_timer.start_time + fps_timer.duration)) {
-        sprintf(FPS_str, "%d", frames); 
+        // Emulation time per frame against the frame budget, the headroom run-ahead has left
+        double cost_ms = (cost_frames) ? (double) frame_cost_us / cost_frames / 1e3 : 0.0;
+        snprintf(FPS_str, sizeof(FPS_str), "%d | %.2f ms (%.0f%%) | run-ahead %u", frames, cost_ms,
+                 cost_ms * 1e5 / FRAME_BUDGET_US, run_ahead);
         SDL_SetWindowTitle(window, FPS_str);
         frames = 0;
+        frame_cost_us = worst_frame_cost_us = 0;
+        cost_frames = 0;
         fps_timer.start_time = get_time_us();
     }
 }
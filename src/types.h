@@ -6,4 +6,7 @@
 typedef uint8_t Byte;
 typedef uint16_t Word;
 
+// One console instance, defined in emulator/emulator.h
+typedef struct Emulator Emulator;
+
 #endif // !TYPES_H
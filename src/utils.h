@@ -3,6 +3,9 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+
+#define FNV_OFFSET_BASIS 0xCBF29CE484222325ULL
 
 #define ERROR(format, ...) {                        \
     fprintf(stderr, "***\033[0;31mERROR\033[0m: "); \
@@ -20,4 +23,14 @@
     exit(EXIT_FAILURE);                             \
 }
 
+// FNV-1a, 64 bit. Pass FNV_OFFSET_BASIS, or the hash of the data before to continue it
+static inline uint64_t fnv_hash(const void *data, size_t size, uint64_t hash) {
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
 #endif // !UTILS_H
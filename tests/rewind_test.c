@@ -0,0 +1,170 @@
+#include <stdbool.h>
+#include <string.h>
+
+#define SDL_MAIN_HANDLED
+#include <SDL2/SDL.h>
+
+#include "../src/utils.h"
+#include "../src/emulator/emulator.h"
+#include "../src/emulator/savestate/savestate.h"
+#include "../src/emulator/rewind/rewind.h"
+
+#define TEST_KEYFRAME_INTERVAL 4
+#define WRAP_BUDGET (16 * 1024)
+#define SOAK_BUDGET (24 * 1024)         // A few keyframes, small enough that the ring wraps quickly
+#define SOAK_PUSHES 4000
+#define LARGE_CHANGE 1536               // RAM bytes changed by a large delta, more than most gaps in the ring
+
+/* Every snapshot the ring still holds must restore the exact savestate it was pushed from, whatever
+   mix of wrapping, stepping back and pushing again led to it */
+
+typedef struct {
+    Emulator *emu;
+    Rewind *rewind;
+    Byte **expected;                    // Savestate of each snapshot in the ring, oldest first
+    int count;
+    Byte *state;
+    size_t state_size;
+} History;
+
+static void start_history(History *history, size_t budget);
+static void end_history(History *history);
+static void push(History *history);
+static int step_back(History *history);
+static int rewind_to_oldest(History *history);
+static void change_ram(Emulator *emu, int bytes, Byte low, uint32_t *seed);
+static uint32_t next_random(uint32_t *seed);
+
+static int test_step_back_after_wrap(void) {
+    // Small snapshots until the ring wraps, so the newest one sits just before the oldest
+    History history;
+    start_history(&history, WRAP_BUDGET);
+    uint32_t seed = 0xC0FFEE;
+    int wrapped = 0;
+    for (int i = 0; i < 10000 && !wrapped; i++) {
+        int before = history.count;
+        change_ram(history.emu, 4, 0, &seed);
+        push(&history);
+        wrapped = history.count <= before;
+    }
+    if (!wrapped)
+        ERROR_RETURN("The %d byte ring never wrapped", WRAP_BUDGET);
+
+    // Stepping back must not free the bytes of the oldest snapshots, a large push only fits by dropping them
+    if (step_back(&history) < 0)
+        ERROR_RETURN("Step back after the wrap restored the wrong %s", "state");
+    change_ram(history.emu, LARGE_CHANGE, 1, &seed);
+    push(&history);
+    int status = rewind_to_oldest(&history);
+    end_history(&history);
+    return status;
+}
+
+static int test_random_soak(void) {
+    History history;
+    start_history(&history, SOAK_BUDGET);
+    uint32_t seed = 0x1234567;
+    for (int i = 0; i < SOAK_PUSHES; i++) {
+        // Mostly small deltas, a large one now and then so a push after a step back needs the room
+        change_ram(history.emu, (next_random(&seed) % 8 == 0) ? LARGE_CHANGE : 1 + next_random(&seed) % 16, 0,
+                   &seed);
+        push(&history);
+        if (next_random(&seed) % 5 == 0) {
+            int steps = 1 + next_random(&seed) % 3;
+            for (int j = 0; j < steps && history.count > 1; j++) {
+                if (step_back(&history) < 0)
+                    ERROR_RETURN("Step back after push %d restored the wrong state", i);
+            }
+        }
+    }
+    int status = rewind_to_oldest(&history);
+    end_history(&history);
+    return status;
+}
+
+int main(void) {
+    int failures = 0;
+    if (test_step_back_after_wrap() < 0) {
+        printf("FAIL step back after wrap\n");
+        failures++;
+    }
+    if (test_random_soak() < 0) {
+        printf("FAIL random soak\n");
+        failures++;
+    }
+    if (failures == 0)
+        printf("rewind_test: all snapshots restored\n");
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void start_history(History *history, size_t budget) {
+    history->state_size = savestate_size();
+    history->emu = create_emulator();
+    history->rewind = create_rewind(budget, TEST_KEYFRAME_INTERVAL);
+    history->state = malloc(history->state_size);
+    history->count = 0;
+    history->expected = NULL;
+    if (history->emu == NULL || history->rewind == NULL || history->state == NULL)
+        ERROR_EXIT("Unable to allocate the %s", "test");
+    reset_cpu(history->emu);
+    reset_ppu(history->emu);
+}
+
+static void end_history(History *history) {
+    for (int i = 0; i < history->count; i++)
+        free(history->expected[i]);
+    free(history->expected);
+    free(history->state);
+    destroy_rewind(history->rewind);
+    destroy_emulator(history->emu);
+}
+
+static void push(History *history) {
+    if (rewind_push(history->rewind, history->emu) < 0)
+        ERROR_EXIT("Push %d failed", history->count);
+    history->expected = realloc(history->expected, (history->count + 1) * sizeof(Byte *));
+    history->expected[history->count] = malloc(history->state_size);
+    save_state(history->emu, history->expected[history->count++], history->state_size);
+
+    // The ring dropped its oldest snapshots to make room, they can't be restored anymore
+    int dropped = history->count - rewind_stats(history->rewind).snapshots;
+    for (int i = 0; i < dropped; i++)
+        free(history->expected[i]);
+    memmove(history->expected, history->expected + dropped, (history->count - dropped) * sizeof(Byte *));
+    history->count -= dropped;
+}
+
+static int step_back(History *history) {
+    if (history->count == 0 || rewind_step_back(history->rewind, history->emu) < 0)
+        return -1;
+    save_state(history->emu, history->state, history->state_size);
+    Byte *newest = history->expected[--history->count];
+    int status = (memcmp(history->state, newest, history->state_size) == 0) ? 0 : -1;
+    free(newest);
+    return status;
+}
+
+static int rewind_to_oldest(History *history) {
+    while (history->count > 0) {
+        if (step_back(history) < 0)
+            ERROR_RETURN("Rewinding failed with %d snapshots left", history->count + 1);
+    }
+    if (rewind_step_back(history->rewind, history->emu) == 0)
+        ERROR_RETURN("Rewind still had a snapshot after %s", "the oldest");
+    return 0;
+}
+
+static void change_ram(Emulator *emu, int bytes, Byte low, uint32_t *seed) {
+    // low keeps the new values nonzero, which grows keyframes as they're encoded against zeros
+    for (int i = 0; i < bytes; i++)
+        emu->cpu.Bus.RAM[next_random(seed) % sizeof(emu->cpu.Bus.RAM)] = (Byte) (next_random(seed) | low);
+}
+
+static uint32_t next_random(uint32_t *seed) {
+    // xorshift32
+    uint32_t x = *seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *seed = x;
+}
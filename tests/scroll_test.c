@@ -0,0 +1,142 @@
+#include <stdbool.h>
+#include <string.h>
+
+#define SDL_MAIN_HANDLED
+#include <SDL2/SDL.h>
+
+#include "../src/utils.h"
+#include "../src/emulator/emulator.h"
+
+#define TEST_SCROLLS 40
+#define TEST_SPLITS 200
+
+/* The background of a frame scrolled through PPUSCROLL and PPUCTRL must match the nametables read pixel by
+   pixel from the scrolled position, and a mid-line scroll write must leave what was due before it */
+
+static Emulator *create_scrolled_console(uint32_t seed, enum Mirror_type mirroring, Byte scroll_x, Byte scroll_y,
+                                         Byte control);
+static void run_ppu_frame(Emulator *emu);
+static uint32_t next_random(uint32_t *seed);
+
+static int test_scrolled_frames(void) {
+    uint32_t seed = 77;
+    for (int i = 0; i < TEST_SCROLLS; i++) {
+        Byte scroll_x = (Byte) next_random(&seed), scroll_y = (Byte) (next_random(&seed) % NES_HEIGHT);
+        Byte control = (Byte) (next_random(&seed) & 0x13);     // Nametable select and background table
+        Emulator *emu = create_scrolled_console(next_random(&seed), (i & 1) ? VERTICAL : HORIZONTAL,
+                                                scroll_x, scroll_y, control);
+        // The first frame starts at power up, the second one at the scroll copied on the pre-render line
+        run_ppu_frame(emu);
+        run_ppu_frame(emu);
+
+        int errors = 0;
+        Word table = (control & 0x10) ? 0x100 : 0x000;
+        for (int y = 0; y < NES_HEIGHT; y++) {
+            for (int x = 0; x < NES_WIDTH; x++) {
+                // Scrolled position on the 512x480 plane of the four nametables
+                int plane_x = ((control & 0x1) * NES_WIDTH + scroll_x + x) % (NES_WIDTH * 2);
+                int plane_y = ((control >> 1 & 0x1) * NES_HEIGHT + scroll_y + y) % (NES_HEIGHT * 2);
+                Word address = 0x2000 | (Word) ((plane_y / NES_HEIGHT) << 11) | (Word) ((plane_x / NES_WIDTH) << 10) |
+                               (Word) ((plane_y % NES_HEIGHT) / 8 << 5) | (Word) ((plane_x % NES_WIDTH) / 8);
+                const Byte *pixels = get_tile_row(emu, table | ppu_read_byte(emu, address), (Byte) (plane_y % 8));
+                errors += emu->ppu.screen_buffer[y * NES_WIDTH + x] != emu->ppu.palette_colors[pixels[plane_x % 8]];
+            }
+        }
+        destroy_emulator(emu);
+        if (errors)
+            ERROR_RETURN("Scroll %d, %d of nametable %d: %d pixels differ", scroll_x, scroll_y, control & 0x3, errors);
+    }
+    return 0;
+}
+
+static int test_mid_line_writes(void) {
+    static uint32_t expected[NES_WIDTH * NES_HEIGHT];
+    uint32_t seed = 1;
+    for (int i = 0; i < TEST_SPLITS; i++) {
+        Byte scroll_x = (Byte) next_random(&seed), new_scroll_x = (Byte) next_random(&seed);
+        int line = (int) (next_random(&seed) % NES_HEIGHT), dot = 1 + (int) (next_random(&seed) % 300);
+        Emulator *emu = create_scrolled_console(5, VERTICAL, scroll_x, 0, 0);
+        run_ppu_frame(emu);
+        memcpy(expected, emu->ppu.screen_buffer, sizeof(expected));
+        destroy_emulator(emu);
+
+        // Same frame with PPUSCROLL written again from the middle of a line
+        emu = create_scrolled_console(5, VERTICAL, scroll_x, 0, 0);
+        emu->ppu.frame_complete = false;
+        while (emu->ppu.scanlines != line || emu->ppu.dots != dot)
+            ppu_clock(emu);
+        int due = line * NES_WIDTH + scanline_due_x(&emu->ppu);
+        cpu_to_ppu_write(emu, 0x2005, new_scroll_x);
+        cpu_to_ppu_write(emu, 0x2005, 0);
+        while (!emu->ppu.frame_complete)
+            ppu_clock(emu);
+        int size = (new_scroll_x == scroll_x) ? NES_WIDTH * NES_HEIGHT : due;
+        int status = memcmp(emu->ppu.screen_buffer, expected, size * sizeof(*expected));
+        destroy_emulator(emu);
+        if (status != 0)
+            ERROR_RETURN("Scroll written on line %d dot %d changed the pixels drawn before it", line, dot);
+    }
+    return 0;
+}
+
+int main(void) {
+    int failures = 0;
+    if (test_scrolled_frames() < 0) {
+        printf("FAIL scrolled frames\n");
+        failures++;
+    }
+    if (test_mid_line_writes() < 0) {
+        printf("FAIL mid-line writes\n");
+        failures++;
+    }
+    if (failures == 0)
+        printf("scroll_test: all frames match\n");
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static Emulator *create_scrolled_console(uint32_t seed, enum Mirror_type mirroring, Byte scroll_x, Byte scroll_y,
+                                         Byte control) {
+    // An NROM cartridge of random CHR over random nametables and palettes, one frame past power up
+    Emulator *emu = create_emulator();
+    if (emu == NULL)
+        ERROR_EXIT("Unable to allocate the %s", "emulator");
+    reset_cpu(emu);
+    reset_ppu(emu);
+    Mapper *mapper = &emu->mapper;
+    mapper->PRG_ROM_banks = 2;
+    mapper->PRG_ROM_p = calloc(1, 0x8000);
+    mapper->CHR_ROM_banks = 1;
+    mapper->CHR_ROM_p = malloc(0x2000);
+    if (!mapper->PRG_ROM_p || !mapper->CHR_ROM_p || load_mapper_functions(mapper, NROM, mirroring) < 0)
+        ERROR_EXIT("Unable to create the %s", "cartridge");
+    for (int i = 0; i < 0x2000; i++)
+        mapper->CHR_ROM_p[i] = (Byte) next_random(&seed);
+    for (int i = 0; i < (int) sizeof(emu->ppu.Bus.Nametable); i++)
+        emu->ppu.Bus.Nametable[i / 1024][i % 1024] = (Byte) next_random(&seed);
+    for (int i = 0; i < (int) sizeof(emu->ppu.Bus.Palettes); i++)
+        emu->ppu.Bus.Palettes[i] = (Byte) (next_random(&seed) & 0x3F);
+    map_cpu_pages(emu);
+    map_nametables(emu);
+
+    cpu_to_ppu_write(emu, 0x2000, control);
+    cpu_to_ppu_write(emu, 0x2005, scroll_x);
+    cpu_to_ppu_write(emu, 0x2005, scroll_y);
+    cpu_to_ppu_write(emu, 0x2001, 0x08);       // Background only
+    run_ppu_frame(emu);
+    return emu;
+}
+
+static void run_ppu_frame(Emulator *emu) {
+    emu->ppu.frame_complete = false;
+    while (!emu->ppu.frame_complete)
+        ppu_clock(emu);
+}
+
+static uint32_t next_random(uint32_t *seed) {
+    // xorshift32
+    uint32_t x = *seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *seed = x;
+}